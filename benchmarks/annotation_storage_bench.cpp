@@ -0,0 +1,209 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "genpybind/annotated_decl.h"
+#include "genpybind/annotations/annotation.h"
+#include "genpybind/annotations/parser.h"
+#include "genpybind/lookup_context_collector.h"
+#include "synthetic_ast.h"
+
+#include <benchmark/benchmark.h>
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Attr.h>
+#include <clang/AST/Decl.h>
+#include <clang/AST/DeclBase.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/STLForwardCompat.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Casting.h>
+#include <llvm/Support/Error.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+using namespace genpybind;
+
+using annotations::Annotation;
+using annotations::Parser;
+
+namespace {
+
+/// Baseline for the benchmarks below, which mirrors how annotations were
+/// stored before they were moved to an arena: one hash map per attribute
+/// kind, with queries returning copies of the attributes.
+class MapOfMapsStorage {
+  template <typename T>
+  using Map = std::unordered_map<const clang::NamedDecl *, T>;
+  using AttrTypes =
+      std::tuple<NamedDeclAttrs, NamespaceDeclAttrs, EnumDeclAttrs,
+                 RecordDeclAttrs, TypedefNameDeclAttrs, FieldOrVarDeclAttrs,
+                 OperatorDeclAttrs, ConversionFunctionDeclAttrs,
+                 MethodDeclAttrs, ConstructorDeclAttrs, FunctionDeclAttrs>;
+
+  template <typename T> struct MapsOf;
+  template <typename... Ts> struct MapsOf<std::tuple<Ts...>> {
+    using type = std::tuple<Map<Ts>...>;
+  };
+
+  // clang-format off
+  MapsOf<AttrTypes>::type attrs_by_decl;
+  // clang-format on
+
+  static Parser::Annotations parseAnnotations(const clang::Decl *decl) {
+    Parser::Annotations annotations;
+    for (const auto *attr : decl->specific_attrs<clang::AnnotateAttr>()) {
+      llvm::StringRef annotation_text = attr->getAnnotation();
+      if (!annotation_text.consume_front("◊"))
+        continue;
+      llvm::consumeError(
+          Parser::parseAnnotations(annotation_text, annotations));
+    }
+    return annotations;
+  }
+
+public:
+  void insert(const clang::NamedDecl *decl) {
+    if (std::get<Map<NamedDeclAttrs>>(attrs_by_decl).contains(decl))
+      return;
+
+    std::vector<std::function<bool(const Annotation &)>> handlers;
+    std::apply(
+        [&](auto &...map) {
+          ((llvm::remove_cvref_t<decltype(map)>::mapped_type::supports(decl)
+                ? handlers.push_back(
+                      [decl, &attrs = map[decl]](const Annotation &annotation) {
+                        return processAnnotation(decl, annotation, attrs);
+                      })
+                : void()),
+           ...);
+        },
+        attrs_by_decl);
+
+    if (!llvm::isa<clang::NamespaceDecl>(decl) &&
+        hasAnnotations(decl, /*allow_empty=*/false)) {
+      std::get<Map<NamedDeclAttrs>>(attrs_by_decl)[decl].visible = true;
+    }
+
+    for (const Annotation &annotation : parseAnnotations(decl)) {
+      benchmark::DoNotOptimize(llvm::any_of(
+          handlers, [&](const auto &handler) { return handler(annotation); }));
+    }
+  }
+
+  template <typename T>
+  std::optional<T> get(const clang::NamedDecl *decl) const {
+    const auto &map = std::get<Map<T>>(attrs_by_decl);
+    if (auto it = map.find(decl); it != map.end())
+      return it->second;
+    return std::nullopt;
+  }
+
+  template <typename T> T lookup(const clang::NamedDecl *decl) const {
+    if (auto attrs = get<T>(decl))
+      return *attrs;
+    return T();
+  }
+};
+
+struct LookupContexts {
+  /// Named declarations in all lookup contexts, whether annotated or not.
+  std::vector<const clang::NamedDecl *> named_decls;
+  /// The subset of `named_decls` that is annotated.
+  std::vector<const clang::NamedDecl *> annotated_decls;
+};
+
+const LookupContexts &syntheticLookupContexts() {
+  static const LookupContexts result = [] {
+    clang::TranslationUnitDecl *tu =
+        bench::syntheticAST().getASTContext().getTranslationUnitDecl();
+    AnnotationStorage annotations;
+    LookupContextCollector visitor(annotations);
+    visitor.TraverseDecl(tu);
+
+    LookupContexts contexts;
+    for (const clang::DeclContext *context : visitor.lookup_contexts) {
+      for (const clang::Decl *decl : context->decls()) {
+        const auto *named_decl = llvm::dyn_cast<clang::NamedDecl>(decl);
+        if (named_decl == nullptr)
+          continue;
+        contexts.named_decls.push_back(named_decl);
+        if (annotations.has(named_decl))
+          contexts.annotated_decls.push_back(named_decl);
+      }
+    }
+    return contexts;
+  }();
+  return result;
+}
+
+/// Extract the annotations of all declarations, as done on the initial pass.
+void BM_AnnotationStorageCollect(benchmark::State &state) {
+  clang::TranslationUnitDecl *tu =
+      bench::syntheticAST().getASTContext().getTranslationUnitDecl();
+  for (auto _ : state) {
+    AnnotationStorage annotations;
+    LookupContextCollector visitor(annotations);
+    visitor.TraverseDecl(tu);
+    benchmark::DoNotOptimize(annotations.size());
+  }
+}
+BENCHMARK(BM_AnnotationStorageCollect)->Unit(benchmark::kMillisecond);
+
+/// Insert all annotated declarations, without the traversal, s.t. the
+/// storage can be compared against `MapOfMapsStorage`.
+template <typename Storage>
+void BM_AnnotationStorageInsert(benchmark::State &state) {
+  const auto &decls = syntheticLookupContexts().annotated_decls;
+  for (auto _ : state) {
+    Storage annotations;
+    for (const clang::NamedDecl *decl : decls)
+      annotations.insert(decl);
+    benchmark::DoNotOptimize(annotations);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(decls.size()));
+}
+BENCHMARK_TEMPLATE(BM_AnnotationStorageInsert, AnnotationStorage)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_AnnotationStorageInsert, MapOfMapsStorage)
+    ->Unit(benchmark::kMillisecond);
+
+/// Query attributes for every declaration in every lookup context, in the
+/// same way the emitter does when exposing a declaration context.
+template <typename Storage>
+void BM_AnnotationStorageQuery(benchmark::State &state) {
+  const LookupContexts &contexts = syntheticLookupContexts();
+  Storage annotations;
+  for (const clang::NamedDecl *decl : contexts.annotated_decls)
+    annotations.insert(decl);
+
+  std::size_t num_queries = 0;
+  for (auto _ : state) {
+    for (const clang::NamedDecl *named_decl : contexts.named_decls) {
+      const auto &named_attrs =
+          annotations.template lookup<NamedDeclAttrs>(named_decl);
+      benchmark::DoNotOptimize(named_attrs.spelling.size());
+      benchmark::DoNotOptimize(
+          annotations.template get<RecordDeclAttrs>(named_decl));
+      benchmark::DoNotOptimize(
+          annotations.template get<MethodDeclAttrs>(named_decl));
+      benchmark::DoNotOptimize(
+          annotations.template get<FunctionDeclAttrs>(named_decl));
+      num_queries += 4;
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(num_queries));
+}
+BENCHMARK_TEMPLATE(BM_AnnotationStorageQuery, AnnotationStorage)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_AnnotationStorageQuery, MapOfMapsStorage)
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
@@ -0,0 +1,242 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "genpybind/annotated_decl.h"
+#include "genpybind/decl_context_graph.h"
+#include "genpybind/decl_context_graph_builder.h"
+#include "genpybind/decl_context_graph_processing.h"
+#include "genpybind/visible_decls.h"
+#include "synthetic_ast.h"
+
+#include <benchmark/benchmark.h>
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclBase.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+using namespace genpybind;
+
+namespace {
+
+/// Shapes of declaration context graphs that stress different parts of the
+/// graph passes.
+enum class GraphShape {
+  /// Namespaces nested `size` levels deep, each with a visible class.
+  DeepNesting,
+  /// `size` sibling namespaces with several classes each, some of them
+  /// hidden, s.t. pruning has work to do.
+  WideNamespaces,
+  /// `size` classes, each with up to four public bases, which become
+  /// dependencies in the topological sort.
+  MultipleInheritance,
+};
+
+std::string generateSource(GraphShape shape, std::int64_t size) {
+  std::string code;
+  llvm::raw_string_ostream os(code);
+  os << "#pragma once\n\n#include <genpybind/genpybind.h>\n\n";
+  switch (shape) {
+  case GraphShape::DeepNesting:
+    for (std::int64_t level = 0; level != size; ++level) {
+      os << "namespace level_" << level << " GENPYBIND(visible) {\n"
+         << "struct Example_" << level << " {\n"
+         << "  void method();\n"
+         << "  struct Nested {\n"
+         << "    void method();\n"
+         << "  };\n"
+         << "};\n";
+    }
+    for (std::int64_t level = 0; level != size; ++level)
+      os << "}\n";
+    break;
+  case GraphShape::WideNamespaces:
+    for (std::int64_t ns = 0; ns != size; ++ns) {
+      os << "namespace ns_" << ns << " GENPYBIND(visible) {\n";
+      for (int cls = 0; cls != 8; ++cls) {
+        os << "struct " << (cls % 4 == 3 ? "GENPYBIND(hidden) " : "")
+           << "Example_" << cls << " {\n"
+           << "  void method();\n"
+           << "};\n";
+      }
+      os << "namespace detail {\n"
+         << "struct Unexposed {};\n"
+         << "} // namespace detail\n"
+         << "} // namespace ns_" << ns << "\n";
+    }
+    break;
+  case GraphShape::MultipleInheritance:
+    os << "namespace classes GENPYBIND(visible) {\n";
+    for (std::int64_t cls = 0; cls != size; ++cls) {
+      os << "struct Class_" << cls;
+      const char *separator = " : ";
+      for (std::int64_t distance : {1, 2, 4, 8}) {
+        if (distance > cls)
+          break;
+        os << separator << "public Class_" << (cls - distance);
+        separator = ", ";
+      }
+      os << " {\n"
+         << "  void method_" << cls << "();\n"
+         << "};\n";
+    }
+    os << "} // namespace classes\n";
+    break;
+  }
+  return code;
+}
+
+/// Return the AST for the given shape and size, which is parsed once and
+/// shared by all benchmarks.
+clang::ASTUnit &syntheticGraphAST(GraphShape shape, std::int64_t size) {
+  static std::map<std::pair<GraphShape, std::int64_t>,
+                  std::unique_ptr<clang::ASTUnit>>
+      asts;
+  std::unique_ptr<clang::ASTUnit> &ast = asts[{shape, size}];
+  if (ast == nullptr) {
+    const std::string file_name =
+        ("graph_" + llvm::Twine(static_cast<int>(shape)) + "_" +
+         llvm::Twine(size) + ".h")
+            .str();
+    ast = bench::parseSyntheticCode(generateSource(shape, size), file_name);
+  }
+  return *ast;
+}
+
+/// The inputs of each pass, as computed by the preceding passes.
+struct GraphPasses {
+  clang::ASTUnit &ast;
+  AnnotationStorage annotations;
+  std::optional<DeclContextGraph> graph;
+  EffectiveVisibilityMap visibilities;
+  ConstDeclContextSet contexts_with_visible_decls;
+  std::optional<DeclContextGraph> pruned_graph;
+  EnclosingScopeMap parents;
+
+  GraphPasses(GraphShape shape, std::int64_t size)
+      : ast(syntheticGraphAST(shape, size)) {
+    DeclContextGraphBuilder builder(
+        annotations, ast.getASTContext().getTranslationUnitDecl());
+    graph = builder.buildGraph();
+    if (!graph.has_value())
+      llvm::report_fatal_error("could not build graph");
+    visibilities = deriveEffectiveVisibility(*graph, annotations);
+    VisibleDeclsCache visible_decls(ast.getSema());
+    contexts_with_visible_decls = declContextsWithVisibleNamedDecls(
+        visible_decls, &*graph, annotations, visibilities);
+    pruned_graph =
+        pruneGraph(*graph, contexts_with_visible_decls, visibilities);
+    parents = findEnclosingScopes(*pruned_graph, annotations);
+  }
+};
+
+void setGraphCounters(benchmark::State &state, const DeclContextGraph &graph) {
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) *
+                          graph.size());
+  state.counters["nodes"] = graph.size();
+}
+
+void BM_BuildGraph(benchmark::State &state, GraphShape shape) {
+  GraphPasses passes(shape, state.range(0));
+  for (auto _ : state) {
+    AnnotationStorage annotations;
+    DeclContextGraphBuilder builder(
+        annotations, passes.ast.getASTContext().getTranslationUnitDecl());
+    benchmark::DoNotOptimize(builder.buildGraph());
+  }
+  setGraphCounters(state, *passes.graph);
+}
+
+void BM_DeriveEffectiveVisibility(benchmark::State &state, GraphShape shape) {
+  GraphPasses passes(shape, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        deriveEffectiveVisibility(*passes.graph, passes.annotations));
+  }
+  setGraphCounters(state, *passes.graph);
+}
+
+void BM_DeclContextsWithVisibleNamedDecls(benchmark::State &state,
+                                          GraphShape shape) {
+  GraphPasses passes(shape, state.range(0));
+  for (auto _ : state) {
+    // Start with a cold cache, as each module run does.
+    VisibleDeclsCache visible_decls(passes.ast.getSema());
+    benchmark::DoNotOptimize(declContextsWithVisibleNamedDecls(
+        visible_decls, &*passes.graph, passes.annotations,
+        passes.visibilities));
+  }
+  setGraphCounters(state, *passes.graph);
+}
+
+void BM_PruneGraph(benchmark::State &state, GraphShape shape) {
+  GraphPasses passes(shape, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pruneGraph(*passes.graph,
+                                        passes.contexts_with_visible_decls,
+                                        passes.visibilities));
+  }
+  setGraphCounters(state, *passes.graph);
+}
+
+void BM_FindEnclosingScopes(benchmark::State &state, GraphShape shape) {
+  GraphPasses passes(shape, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        findEnclosingScopes(*passes.pruned_graph, passes.annotations));
+  }
+  setGraphCounters(state, *passes.pruned_graph);
+}
+
+/// Covers `lexicographicalTopologicalSort`, including the comparisons via
+/// `SourceManager::isBeforeInTranslationUnit`.
+void BM_DeclContextsSortedByDependencies(benchmark::State &state,
+                                         GraphShape shape) {
+  GraphPasses passes(shape, state.range(0));
+  const clang::SourceManager &source_manager = passes.ast.getSourceManager();
+  for (auto _ : state) {
+    const clang::DeclContext *cycle = nullptr;
+    benchmark::DoNotOptimize(declContextsSortedByDependencies(
+        *passes.pruned_graph, passes.parents, source_manager, &cycle));
+  }
+  setGraphCounters(state, *passes.pruned_graph);
+}
+
+void graphSizes(benchmark::internal::Benchmark *benchmark) {
+  benchmark->RangeMultiplier(4)->Range(16, 1024)->Unit(
+      benchmark::kMicrosecond);
+}
+
+// Clang limits the nesting of braces to a depth of 256 by default.
+void nestingDepths(benchmark::internal::Benchmark *benchmark) {
+  benchmark->RangeMultiplier(2)->Range(16, 128)->Unit(benchmark::kMicrosecond);
+}
+
+#define GENPYBIND_GRAPH_BENCHMARK(name)                                        \
+  BENCHMARK_CAPTURE(name, deep_nesting, GraphShape::DeepNesting)               \
+      ->Apply(nestingDepths);                                                  \
+  BENCHMARK_CAPTURE(name, wide_namespaces, GraphShape::WideNamespaces)         \
+      ->Apply(graphSizes);                                                     \
+  BENCHMARK_CAPTURE(name, multiple_inheritance,                                \
+                    GraphShape::MultipleInheritance)                           \
+      ->Apply(graphSizes)
+
+GENPYBIND_GRAPH_BENCHMARK(BM_BuildGraph);
+GENPYBIND_GRAPH_BENCHMARK(BM_DeriveEffectiveVisibility);
+GENPYBIND_GRAPH_BENCHMARK(BM_DeclContextsWithVisibleNamedDecls);
+GENPYBIND_GRAPH_BENCHMARK(BM_PruneGraph);
+GENPYBIND_GRAPH_BENCHMARK(BM_FindEnclosingScopes);
+GENPYBIND_GRAPH_BENCHMARK(BM_DeclContextsSortedByDependencies);
+
+} // namespace
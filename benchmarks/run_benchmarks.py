@@ -0,0 +1,159 @@
+# SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+#
+# SPDX-License-Identifier: MIT
+
+"""Measure wall time, peak RSS and emitted bytes of genpybind-tool for
+synthetic headers of increasing size.
+
+Starting from a base shape (see `--base-*`), one dimension of the header is
+multiplied by each of the given scales (see `--vary`).  For each pair of
+consecutive sizes, the scaling exponent k in t ~ n^k is reported, where n is
+the value of the varied dimension.  Values noticeably above 1 indicate
+superlinear behavior.
+"""
+
+from __future__ import annotations
+
+import argparse
+import dataclasses
+import json
+import math
+import os
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+from synthetic_header import Shape, generate
+
+
+def peak_rss_bytes(rusage) -> int:
+    # `ru_maxrss` is reported in bytes on macOS and in kilobytes elsewhere.
+    if sys.platform == "darwin":
+        return rusage.ru_maxrss
+    return rusage.ru_maxrss * 1024
+
+
+def run_tool(command: list[str]) -> tuple[float, int]:
+    """Run `command` and return its wall time and peak RSS."""
+    start = time.perf_counter()
+    pid = os.spawnv(os.P_NOWAIT, command[0], command)
+    _, status, rusage = os.wait4(pid, 0)
+    elapsed = time.perf_counter() - start
+    if os.waitstatus_to_exitcode(status) != 0:
+        raise RuntimeError(f"command failed: {' '.join(command)}")
+    return elapsed, peak_rss_bytes(rusage)
+
+
+def measure(args, scale: int, workdir: Path) -> dict:
+    shape = args.base_shape.scaled(scale, args.vary)
+    name = f"synthetic_{args.vary}_{getattr(shape, args.vary)}"
+    header = workdir / f"{name}.h"
+    header.write_text(generate(shape))
+    outputs = [workdir / f"{name}_{idx}.cpp" for idx in range(args.num_binding_files)]
+    command = [
+        args.tool,
+        str(header),
+        *[f"-o={output}" for output in outputs],
+        *args.tool_args,
+        "--",
+        "-std=c++17",
+        f"-I{args.includes}",
+    ]
+
+    times = []
+    peak_rss = 0
+    for _ in range(args.repetitions):
+        elapsed, rss = run_tool(command)
+        times.append(elapsed)
+        peak_rss = max(peak_rss, rss)
+
+    return {
+        "shape": shape.__dict__,
+        "varied": args.vary,
+        "scale": scale,
+        "size": getattr(shape, args.vary),
+        "exposed_methods": shape.exposed_methods,
+        "wall_time_s": min(times),
+        "peak_rss_bytes": peak_rss,
+        "emitted_bytes": sum(output.stat().st_size for output in outputs),
+    }
+
+
+def print_table(results: list[dict]) -> None:
+    varied = results[0]["varied"] if results else "size"
+    width = max(8, len(varied))
+    print(
+        f"{varied:>{width}} {'exposed':>8} {'time [s]':>9} {'exponent':>8} "
+        f"{'peak RSS [MiB]':>14} {'emitted [KiB]':>13}"
+    )
+    previous = None
+    for result in results:
+        exponent = ""
+        if previous is not None and previous["size"] > 0:
+            ratio_time = result["wall_time_s"] / previous["wall_time_s"]
+            ratio_size = result["size"] / previous["size"]
+            if ratio_size != 1:
+                exponent = f"{math.log(ratio_time) / math.log(ratio_size):.2f}"
+        print(
+            f"{result['size']:>{width}} {result['exposed_methods']:>8} "
+            f"{result['wall_time_s']:>9.3f} "
+            f"{exponent:>8} {result['peak_rss_bytes'] / 2**20:>14.1f} "
+            f"{result['emitted_bytes'] / 2**10:>13.1f}"
+        )
+        previous = result
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--tool", required=True, help="path to genpybind-tool")
+    parser.add_argument(
+        "--includes", required=True, help="directory containing genpybind.h"
+    )
+    parser.add_argument(
+        "--scales",
+        type=int,
+        nargs="+",
+        default=[1, 2, 4, 8, 16],
+        help="multiples of the varied dimension to measure",
+    )
+    fields = [field.name for field in dataclasses.fields(Shape)]
+    parser.add_argument(
+        "--vary",
+        choices=fields,
+        default="namespaces",
+        help="dimension of the base shape that is multiplied by each scale",
+    )
+    for field in dataclasses.fields(Shape):
+        parser.add_argument(
+            "--base-" + field.name.replace("_", "-"),
+            type=int,
+            default=field.default,
+            help=f"{field.name} of the base shape (default: {field.default})",
+        )
+    parser.add_argument("--repetitions", type=int, default=3)
+    parser.add_argument("--num-binding-files", type=int, default=1)
+    parser.add_argument("--json", type=Path, help="also write results as JSON")
+    parser.add_argument(
+        "--workdir", type=Path, help="keep generated files in this directory"
+    )
+    parser.add_argument(
+        "tool_args", nargs="*", help="additional arguments for genpybind-tool"
+    )
+    args = parser.parse_args()
+    args.base_shape = Shape(
+        **{field: getattr(args, "base_" + field) for field in fields}
+    )
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        workdir = args.workdir or Path(tmpdir)
+        workdir.mkdir(parents=True, exist_ok=True)
+        results = [measure(args, scale, workdir) for scale in args.scales]
+
+    print_table(results)
+    if args.json is not None:
+        args.json.write_text(json.dumps(results, indent=2) + "\n")
+
+
+if __name__ == "__main__":
+    main()
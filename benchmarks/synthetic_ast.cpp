@@ -0,0 +1,38 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "synthetic_ast.h"
+
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Tooling/Tooling.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+std::unique_ptr<clang::ASTUnit>
+genpybind::bench::parseSyntheticCode(llvm::StringRef code,
+                                     llvm::StringRef file_name) {
+  const std::vector<std::string> args = {
+      "-xc++", "-std=c++17", "-D__GENPYBIND__", "-Wno-everything",
+      "-I" GENPYBIND_PUBLIC_INCLUDE_DIR};
+  auto unit = clang::tooling::buildASTFromCodeWithArgs(code, args, file_name);
+  if (unit == nullptr)
+    llvm::report_fatal_error("could not parse synthetic header");
+  return unit;
+}
+
+clang::ASTUnit &genpybind::bench::syntheticAST() {
+  static const std::unique_ptr<clang::ASTUnit> ast = [] {
+    auto buffer = llvm::MemoryBuffer::getFile(GENPYBIND_SYNTHETIC_HEADER);
+    if (!buffer)
+      llvm::report_fatal_error("could not read synthetic header");
+    return parseSyntheticCode((*buffer)->getBuffer(),
+                              GENPYBIND_SYNTHETIC_HEADER);
+  }();
+  return *ast;
+}
@@ -0,0 +1,26 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+
+#include <memory>
+
+namespace clang {
+class ASTUnit;
+} // namespace clang
+
+namespace genpybind::bench {
+
+/// Return the AST of the synthetic header generated at build time, which is
+/// parsed once on first use and shared by all microbenchmarks.
+clang::ASTUnit &syntheticAST();
+
+/// Parse `code` as an annotated header, with the same arguments as used for
+/// the synthetic header.  Fails hard if the code cannot be parsed.
+std::unique_ptr<clang::ASTUnit> parseSyntheticCode(llvm::StringRef code,
+                                                   llvm::StringRef file_name);
+
+} // namespace genpybind::bench
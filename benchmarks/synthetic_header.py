@@ -0,0 +1,144 @@
+# SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+#
+# SPDX-License-Identifier: MIT
+
+"""Generate synthetic annotated headers to measure how genpybind scales."""
+
+from __future__ import annotations
+
+import argparse
+import dataclasses
+import sys
+from pathlib import Path
+
+
+@dataclasses.dataclass(frozen=True)
+class Shape:
+    namespaces: int = 4
+    # How often each namespace is reopened (i.e., the number of blocks per namespace).
+    reopenings: int = 2
+    classes: int = 8  # per namespace block
+    methods: int = 8  # per class
+    overloads: int = 2  # per method
+    inline_base_chain: int = 2  # length of `inline_base` chains per namespace
+    aliases: int = 2  # `expose_here` aliases per namespace block
+    instantiations: int = 2  # annotated template instantiations per namespace
+
+    def scaled(self, factor: int, field: str = "namespaces") -> Shape:
+        """Return a shape where `field` is multiplied by `factor`."""
+        return dataclasses.replace(self, **{field: getattr(self, field) * factor})
+
+    @property
+    def exposed_methods(self) -> int:
+        per_block = self.classes * self.methods * self.overloads
+        return self.namespaces * self.reopenings * per_block
+
+
+def _emit_class(out, name: str, shape: Shape, annotation: str | None = None) -> None:
+    annotation = f"GENPYBIND({annotation}) " if annotation else ""
+    out.append(f"struct {annotation}{name} {{")
+    out.append(f"  {name}();")
+    for method in range(shape.methods):
+        for overload in range(shape.overloads):
+            params = ", ".join(["int"] * overload)
+            out.append(f"  /// Method {method} (overload {overload}).")
+            out.append(f"  double method_{method}({params}) const;")
+    out.append("  int field = 0;")
+    out.append("};")
+
+
+def generate(shape: Shape) -> str:
+    out = [
+        "// Generated by synthetic_header.py, do not edit.",
+        "#pragma once",
+        "",
+        "#include <genpybind/genpybind.h>",
+        "",
+    ]
+
+    for ns in range(shape.namespaces):
+        for block in range(shape.reopenings):
+            # Types from an unexposed namespace, which are moved via `expose_here`.
+            for alias in range(shape.aliases):
+                out.append(f"namespace detail_{ns}_{block}_{alias} {{")
+                _emit_class(out, "Detail", shape)
+                out.append(f"}} // namespace detail_{ns}_{block}_{alias}")
+                out.append("")
+
+            out.append(f"namespace ns_{ns} GENPYBIND(visible) {{")
+            out.append("")
+            for cls in range(shape.classes):
+                _emit_class(out, f"Class_{block}_{cls}", shape, "visible")
+                out.append(
+                    f"Class_{block}_{cls} make_{block}_{cls}(const Class_{block}_{cls} &other);"
+                )
+                out.append("")
+
+            for alias in range(shape.aliases):
+                out.append(
+                    f"using Alias_{block}_{alias} GENPYBIND(expose_here) = "
+                    f"detail_{ns}_{block}_{alias}::Detail;"
+                )
+            out.append("")
+
+            out.append(f"}} // namespace ns_{ns}")
+            out.append("")
+
+        out.append(f"namespace ns_{ns} GENPYBIND(visible) {{")
+        if shape.inline_base_chain > 0:
+            _emit_class(out, "Chain_0", shape)
+            for link in range(1, shape.inline_base_chain + 1):
+                out.append(
+                    f"struct GENPYBIND(visible, inline_base(Chain_{link - 1})) "
+                    f"Chain_{link} : Chain_{link - 1} {{"
+                )
+                out.append(f"  int link_{link}() const;")
+                out.append("};")
+            out.append("")
+
+        if shape.instantiations > 0:
+            out.append("template <typename T> struct GENPYBIND(visible) Templated {")
+            for method in range(shape.methods):
+                out.append(f"  T method_{method}(T value) const {{ return value; }}")
+            out.append("};")
+            for inst in range(shape.instantiations):
+                out.append(f"template <int N> struct Tag_{inst} {{}};")
+                out.append(
+                    f"extern template struct GENPYBIND(expose_as(Templated_{inst})) "
+                    f"Templated<Tag_{inst}<{ns}>>;"
+                )
+            out.append("")
+        out.append(f"}} // namespace ns_{ns}")
+        out.append("")
+
+    return "\n".join(out)
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__)
+    for field in dataclasses.fields(Shape):
+        parser.add_argument(
+            "--" + field.name.replace("_", "-"), type=int, default=field.default
+        )
+    parser.add_argument("--scale", type=int, default=1, help="multiply --vary")
+    parser.add_argument(
+        "--vary",
+        choices=[field.name for field in dataclasses.fields(Shape)],
+        default="namespaces",
+        help="dimension multiplied by --scale",
+    )
+    parser.add_argument("-o", "--output", type=Path, help="defaults to stdout")
+    args = parser.parse_args()
+
+    shape = Shape(
+        **{field.name: getattr(args, field.name) for field in dataclasses.fields(Shape)}
+    ).scaled(args.scale, args.vary)
+    text = generate(shape)
+    if args.output is None:
+        sys.stdout.write(text)
+    else:
+        args.output.write_text(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -6,15 +6,18 @@
 
 #include "genpybind/annotations/annotation.h"
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallSet.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Allocator.h>
 
 #include <cassert>
+#include <cstddef>
 #include <optional>
 #include <string>
 #include <tuple>
-#include <unordered_map>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -197,58 +200,76 @@ bool processAnnotation(const clang::NamedDecl *decl,
 /// Holds and owns annotations s.t. they do not have to be processed multiple
 /// times.  Currently only named declarations are checked for annotations.
 class AnnotationStorage {
-  template <typename T>
-  using Map = std::unordered_map<const clang::NamedDecl *, T>;
   using AttrTypes =
       std::tuple<NamedDeclAttrs, NamespaceDeclAttrs, EnumDeclAttrs,
                  RecordDeclAttrs, TypedefNameDeclAttrs, FieldOrVarDeclAttrs,
                  OperatorDeclAttrs, ConversionFunctionDeclAttrs,
                  MethodDeclAttrs, ConstructorDeclAttrs, FunctionDeclAttrs>;
 
-  template <typename T> struct MapsOf;
-  template <typename... Ts> struct MapsOf<std::tuple<Ts...>> {
-    using type = std::tuple<Map<Ts>...>;
+  template <typename T> struct StorageOf;
+  template <typename... Ts> struct StorageOf<std::tuple<Ts...>> {
+    /// Attributes of a single declaration, with `nullptr` for the kinds that
+    /// do not apply to it.  Keeping them together means that all queries for
+    /// one declaration are served by a single hash table lookup.
+    using Entry = std::tuple<Ts *...>;
+    using Allocators = std::tuple<llvm::SpecificBumpPtrAllocator<Ts>...>;
   };
 
+  using Entry = StorageOf<AttrTypes>::Entry;
+
   // clang-format off
-  MapsOf<AttrTypes>::type attrs_by_decl;
+  StorageOf<AttrTypes>::Allocators allocators;
   // clang-format on
+  llvm::DenseMap<const clang::NamedDecl *, Entry> entries;
+  std::size_t num_named_decls = 0;
+
+  template <typename T> T *create() {
+    if constexpr (std::is_same_v<T, NamedDeclAttrs>)
+      ++num_named_decls;
+    return new (std::get<llvm::SpecificBumpPtrAllocator<T>>(allocators)
+                    .Allocate()) T();
+  }
 
 public:
+  AnnotationStorage() = default;
+  AnnotationStorage(const AnnotationStorage &) = delete;
+  AnnotationStorage &operator=(const AnnotationStorage &) = delete;
+
   void insert(const clang::NamedDecl *decl);
 
-  template <typename T>
-  std::optional<T> get(const clang::NamedDecl *decl) const {
-    const auto &map = std::get<Map<T>>(attrs_by_decl);
-    if (auto it = map.find(decl); it != map.end()) {
-      return it->second;
-    }
-    return std::nullopt;
+  /// Return the attributes of the given kind, or `nullptr` if none have been
+  /// recorded for the declaration.  The returned pointer remains valid for
+  /// the lifetime of the storage.
+  template <typename T> const T *get(const clang::NamedDecl *decl) const {
+    if (auto it = entries.find(decl); it != entries.end())
+      return std::get<T *>(it->second);
+    return nullptr;
   }
 
   template <typename T, typename UpdateOp>
   void update(const clang::NamedDecl *decl, UpdateOp op) {
     assert(decl != nullptr && T::supports(decl));
-    op(std::get<Map<T>>(attrs_by_decl)[decl]);
+    T *&attrs = std::get<T *>(entries[decl]);
+    if (attrs == nullptr)
+      attrs = create<T>();
+    op(*attrs);
   }
 
-  template <typename T> T lookup(const clang::NamedDecl *decl) const {
+  template <typename T> const T &lookup(const clang::NamedDecl *decl) const {
     assert(decl != nullptr && T::supports(decl));
-    if (auto attrs = get<T>(decl)) {
+    static const T default_attrs{};
+    if (const T *attrs = get<T>(decl))
       return *attrs;
-    }
-    return T();
+    return default_attrs;
   }
 
   bool equal(const clang::NamedDecl *left, const clang::NamedDecl *right) const;
 
-  auto has(const clang::NamedDecl *decl) const {
-    return std::get<Map<NamedDeclAttrs>>(attrs_by_decl).contains(decl);
+  bool has(const clang::NamedDecl *decl) const {
+    return get<NamedDeclAttrs>(decl) != nullptr;
   }
 
-  auto size() const {
-    return std::get<Map<NamedDeclAttrs>>(attrs_by_decl).size();
-  }
+  std::size_t size() const { return num_named_decls; }
 };
 
 } // namespace genpybind
@@ -0,0 +1,89 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "genpybind/shards.h"
+
+#include <llvm/Support/JSON.h>
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace genpybind {
+
+/// Generated code, together with the constructs that determine its compile
+/// cost (as recorded while rendering it).
+struct RenderedCode {
+  std::string code;
+  CodeMetrics metrics;
+};
+
+/// Intermediate representation of the generated bindings for a single
+/// declaration context, i.e., everything that has been decided during the
+/// analysis of the translation unit.  The declarations are already rendered
+/// to code (including their spelling, signature, policies, docstrings and
+/// default arguments), but their placement in `expose_` functions and output
+/// files is left to `emitBindings`.
+struct ContextBindings {
+  /// Identifier of the context object in the module definition, which is also
+  /// used for the name of the corresponding `expose_` function(s).
+  std::string identifier;
+  /// Parameter declaration of the `expose_` function(s).
+  std::string parameter;
+  /// Expression creating the context object based on its parent.
+  RenderedCode introducer;
+  /// Code exposing each declaration, in order.
+  std::vector<RenderedCode> declarations;
+  /// Code emitted after all declarations, e.g., for properties.
+  RenderedCode finalization;
+  /// Whether the declarations have been rendered.  If not, the context is
+  /// handled by a different partition (see `ShardingOptions::partition`).
+  bool is_rendered = true;
+};
+
+/// Intermediate representation of the generated bindings for a module.
+struct ModuleBindings {
+  /// Incremented on incompatible changes to the serialized representation.
+  static constexpr unsigned version = 2;
+
+  std::string module_name;
+  /// Code emitted at the start of each output file that receives bindings.
+  std::string includes;
+  /// Contexts in the order of their introduction in the module definition.
+  std::vector<ContextBindings> contexts;
+  /// Code emitted at the end of the module definition.
+  std::string postamble;
+};
+
+llvm::json::Value toJSON(const CodeMetrics &metrics);
+bool fromJSON(const llvm::json::Value &value, CodeMetrics &metrics,
+              llvm::json::Path path);
+llvm::json::Value toJSON(const RenderedCode &rendered);
+bool fromJSON(const llvm::json::Value &value, RenderedCode &rendered,
+              llvm::json::Path path);
+llvm::json::Value toJSON(const ContextBindings &context);
+bool fromJSON(const llvm::json::Value &value, ContextBindings &context,
+              llvm::json::Path path);
+llvm::json::Value toJSON(const ModuleBindings &module);
+bool fromJSON(const llvm::json::Value &value, ModuleBindings &module,
+              llvm::json::Path path);
+
+/// Emit the bindings for the module, spread over the given streams.  The
+/// `includes` are only emitted to streams that receive any bindings.
+void emitBindings(const ModuleBindings &module,
+                  std::vector<llvm::raw_ostream *> ostreams,
+                  const ShardingOptions &sharding = {});
+
+/// Print a table of the rendered contexts, with the constructs recorded while
+/// rendering them and the emitted bytes of each context, sorted by decreasing
+/// estimated compile cost.  This helps to find the contexts that
+/// would benefit most from hiding declarations or further splitting.
+void printCostReport(llvm::raw_ostream &os, const ModuleBindings &module);
+
+} // namespace genpybind
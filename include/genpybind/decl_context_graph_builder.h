@@ -12,12 +12,14 @@
 
 namespace clang {
 class Decl;
+class Sema;
 class TranslationUnitDecl;
 class TypedefNameDecl;
 } // namespace clang
 
 namespace genpybind {
 class AnnotationStorage;
+class HeaderFilter;
 
 /// Builds a graph of declaration contexts from the AST.  As described for
 /// DeclContextGraph, this graph is used to determine where and in which order
@@ -46,15 +48,23 @@ public:
 private:
   clang::TranslationUnitDecl *translation_unit;
   AnnotationStorage &annotations;
+  clang::Sema *sema;
+  const HeaderFilter *header_filter;
   DeclContextGraph graph;
   RelocatedDeclsMap relocated_decls;
 
   bool addEdgeForExposeHereAlias(const clang::TypedefNameDecl *decl);
 
 public:
+  /// If `sema` is provided, the AST is prepared while collecting the lookup
+  /// contexts.  Headers not considered by `header_filter` are pruned from
+  /// the traversal, see `LookupContextCollector`.
   DeclContextGraphBuilder(AnnotationStorage &annotations,
-                          clang::TranslationUnitDecl *decl)
-      : translation_unit(decl), annotations(annotations), graph(decl) {}
+                          clang::TranslationUnitDecl *decl,
+                          clang::Sema *sema = nullptr,
+                          const HeaderFilter *header_filter = nullptr)
+      : translation_unit(decl), annotations(annotations), sema(sema),
+        header_filter(header_filter), graph(decl) {}
 
   /// Returns a map of moved decls to the `expose_here` alias that was
   /// responsible for its relocation.
@@ -14,13 +14,13 @@
 
 namespace clang {
 class DeclContext;
-class Sema;
 class SourceManager;
 } // namespace clang
 
 namespace genpybind {
 
 class AnnotationStorage;
+class VisibleDeclsCache;
 
 using EnclosingScopeMap =
     llvm::DenseMap<const clang::DeclContext *, const clang::DeclContext *>;
@@ -66,7 +66,7 @@ bool reportExposeHereCycles(
 /// visibility of its descendants, a hidden tag declaration effectively conceals
 /// the sub-tree of all contained declarations.
 ConstDeclContextSet
-declContextsWithVisibleNamedDecls(clang::Sema &sema,
+declContextsWithVisibleNamedDecls(VisibleDeclsCache &visible_decls,
                                   const DeclContextGraph *graph,
                                   const AnnotationStorage &annotations,
                                   const EffectiveVisibilityMap &visibilities);
@@ -35,6 +35,7 @@ struct Diagnostics {
     PreviouslyExposedHereNote,
     PropertyAlreadyDefinedError,
     PropertyHasNoGetterError,
+    SpecializationInstantiatedByDefaultArgumentWarning,
     TrailingParametersError,
     UnreachableDeclContextWarning,
     UnsupportedAliasTargetError,
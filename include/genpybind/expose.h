@@ -4,80 +4,206 @@
 
 #pragma once
 
+#include "genpybind/bindings.h"
 #include "genpybind/decl_context_graph_processing.h"
+#include "genpybind/shards.h"
 #include "genpybind/visible_decls.h"
 
+#include <clang/AST/PrettyPrinter.h>
+#include <clang/AST/Type.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/StringSaver.h>
 
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace clang {
 class ASTContext;
 class CXXMethodDecl;
 class CXXRecordDecl;
+class Decl;
 class DeclContext;
 class EnumDecl;
+class FieldDecl;
 class FunctionDecl;
+class LambdaExpr;
 class NamedDecl;
 class NamespaceDecl;
-class QualType;
+class ParmVarDecl;
 class Sema;
 class TypeDecl;
 enum OverloadedOperatorKind : int;
 } // namespace clang
 namespace llvm {
 class raw_ostream;
-template <typename T> class SmallVectorImpl;
 } // namespace llvm
 
 namespace genpybind {
 class AnnotationStorage;
 class DeclContextGraph;
+struct ModuleStatistics;
 
 std::string getFullyQualifiedName(const clang::TypeDecl *decl);
 
+/// Fully qualified spellings of types, including the global namespace
+/// specifier, as used in the generated bindings.  As the same types tend to
+/// appear in many signatures, each one is only printed once.
+///
+/// Printing a fully qualified name can create types in the `ASTContext`, so
+/// all names are computed before rendering the bindings.  While rendering,
+/// the cache is frozen and can be read from several threads.
+class QualifiedTypeNames {
+  const clang::ASTContext &context;
+  clang::PrintingPolicy printing_policy;
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver{allocator};
+  llvm::DenseMap<clang::QualType, llvm::StringRef> names;
+  bool frozen = false;
+
+public:
+  explicit QualifiedTypeNames(const clang::ASTContext &context);
+
+  const clang::ASTContext &getASTContext() const { return context; }
+  const clang::PrintingPolicy &getPrintingPolicy() const {
+    return printing_policy;
+  }
+
+  /// While frozen, names are only looked up and not added to the cache.
+  void setFrozen(bool value) { frozen = value; }
+
+  /// Return the fully qualified name of the given type.  As the spelling
+  /// depends on type sugar (e.g., typedefs), the cache is keyed by the type as
+  /// written and not by its canonical type.
+  llvm::StringRef get(clang::QualType qual_type);
+  llvm::StringRef get(const clang::TypeDecl *decl);
+};
+
+/// Text derived from declarations that is included in the generated bindings.
+/// Like for `QualifiedTypeNames`, computing it is not thread-safe: Looking up
+/// comments fills caches of the `ASTContext`, default arguments are printed
+/// with fully qualified types and parts of declarations from a precompiled
+/// header are only deserialized on first access.  Thus, all texts are
+/// computed before rendering the bindings and only looked up afterwards.
+class DeclTexts {
+  QualifiedTypeNames &type_names;
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver{allocator};
+  llvm::DenseMap<const clang::Decl *, llvm::StringRef> brief_texts;
+  llvm::DenseMap<const clang::Decl *, llvm::StringRef> initializers;
+  llvm::DenseMap<const clang::LambdaExpr *, llvm::StringRef> manual_bindings;
+  bool frozen = false;
+
+public:
+  explicit DeclTexts(QualifiedTypeNames &type_names)
+      : type_names(type_names) {}
+
+  /// While frozen, texts are only looked up and not added to the cache.
+  void setFrozen(bool value) { frozen = value; }
+
+  /// Return the brief text of the comment attached to `decl`, if any.
+  llvm::StringRef getBriefText(const clang::Decl *decl);
+  /// Return the brief text of `function`, or else of its primary template.
+  llvm::StringRef getDocstring(const clang::FunctionDecl *function);
+  /// Return the default argument of `param` with fully qualified types, or an
+  /// empty string if there is none.
+  llvm::StringRef getInitializer(const clang::ParmVarDecl *param);
+  /// Return the in-class initializer of `field` with fully qualified types, or
+  /// an empty string if there is none.
+  llvm::StringRef getInitializer(const clang::FieldDecl *field);
+  /// Return the code that invokes the given manual bindings.
+  llvm::StringRef getManualBindings(const clang::LambdaExpr *lambda);
+};
+
 class TranslationUnitExposer {
   clang::Sema &sema;
   const DeclContextGraph &graph;
   const EffectiveVisibilityMap &visibilities;
   AnnotationStorage &annotations;
+  VisibleDeclsCache &visible_decls;
+  QualifiedTypeNames type_names;
+  DeclTexts texts{type_names};
 
 public:
   TranslationUnitExposer(clang::Sema &sema, const DeclContextGraph &graph,
                          const EffectiveVisibilityMap &visibilities,
-                         AnnotationStorage &annotations);
+                         AnnotationStorage &annotations,
+                         VisibleDeclsCache &visible_decls);
 
-  void emitModule(std::vector<llvm::raw_ostream *> ostreams,
-                  llvm::StringRef module_name);
+  /// Determine the contexts and declarations to expose and render their
+  /// bindings, which can then be emitted using `emitBindings`.  Only the
+  /// contexts of the given partition are rendered, using up to `num_threads`
+  /// threads.  Returns `std::nullopt` if errors occurred.
+  std::optional<ModuleBindings>
+  exposeModule(llvm::StringRef module_name,
+               const ShardingOptions &sharding = {}, unsigned num_threads = 1);
 };
 
+/// Renders the bindings of a single declaration context.  Everything that
+/// modifies the AST is done by `prepareContext` and `prepareDecl` beforehand,
+/// s.t. different contexts can be rendered concurrently.
 class DeclContextExposer {
+public:
+  /// Diagnostics are only reported after rendering, in a deterministic order.
+  using PendingDiagnostics = std::vector<std::function<void()>>;
+
 protected:
   const AnnotationStorage &annotations;
+  QualifiedTypeNames &type_names;
+  DeclTexts &texts;
+  /// Python-level names of the functions exposed so far, for statistics.
+  llvm::StringSet<> function_names;
+  std::uint64_t num_overloads = 0;
+  std::uint64_t num_operator_lambdas = 0;
+  /// Constructs emitted since the last call to `takeMetrics`.
+  CodeMetrics metrics;
+  PendingDiagnostics diagnostics;
 
 public:
-  DeclContextExposer(const AnnotationStorage &annotations);
+  DeclContextExposer(const AnnotationStorage &annotations,
+                     QualifiedTypeNames &type_names, DeclTexts &texts);
   virtual ~DeclContextExposer() = default;
 
   static std::unique_ptr<DeclContextExposer>
   create(const DeclContextGraph &graph, const AnnotationStorage &annotations,
+         QualifiedTypeNames &type_names, DeclTexts &texts,
          const clang::DeclContext *decl_context);
 
   virtual std::optional<RecordInliningPolicy> inliningPolicy() const;
+  /// Compute the type names and texts needed by `emitParameter`,
+  /// `emitIntroducer` and `finalizeDefinition`.
+  virtual void prepareContext();
+  /// Compute the type names and texts needed by `handleDecl`.
+  virtual void prepareDecl(const clang::NamedDecl *decl);
   virtual void emitParameter(llvm::raw_ostream &os);
   virtual void emitIntroducer(llvm::raw_ostream &os,
                               llvm::StringRef parent_identifier);
   void handleDecl(llvm::raw_ostream &os, const clang::NamedDecl *decl,
                   bool default_visibility);
   virtual void finalizeDefinition(llvm::raw_ostream &os);
+  /// Return the constructs emitted since the last call, which determine the
+  /// compile cost of the generated code.
+  CodeMetrics takeMetrics() { return std::exchange(metrics, {}); }
+  /// Report the diagnostics encountered while rendering so far.
+  void reportDiagnostics();
+  /// Add the functions exposed so far to `statistics`.
+  void addStatistics(ModuleStatistics &statistics) const;
 
 protected:
   virtual void handleDeclImpl(llvm::raw_ostream &os,
                               const clang::NamedDecl *decl);
+  /// Record a function binding named `name` for the statistics.
+  void countFunction(llvm::StringRef name);
 };
 
 class NamespaceExposer : public DeclContextExposer {
@@ -85,7 +211,8 @@ class NamespaceExposer : public DeclContextExposer {
 
 public:
   NamespaceExposer(const clang::NamespaceDecl *namespace_decl,
-                   const AnnotationStorage &annotations);
+                   const AnnotationStorage &annotations,
+                   QualifiedTypeNames &type_names, DeclTexts &texts);
 
   void emitIntroducer(llvm::raw_ostream &os,
                       llvm::StringRef parent_identifier) override;
@@ -96,8 +223,11 @@ class EnumExposer : public DeclContextExposer {
 
 public:
   EnumExposer(const clang::EnumDecl *enum_decl,
-              const AnnotationStorage &annotations);
+              const AnnotationStorage &annotations,
+              QualifiedTypeNames &type_names, DeclTexts &texts);
 
+  void prepareContext() override;
+  void prepareDecl(const clang::NamedDecl *decl) override;
   void emitParameter(llvm::raw_ostream &os) override;
   void emitIntroducer(llvm::raw_ostream &os,
                       llvm::StringRef parent_identifier) override;
@@ -118,14 +248,22 @@ class RecordExposer : public DeclContextExposer {
     const clang::CXXMethodDecl *setter = nullptr;
   };
   std::map<std::string, Property> properties;
+  /// Parameter types of the lambdas generated for operators, including the
+  /// reference to "self" for member functions (see `prepareDecl`).
+  llvm::DenseMap<const clang::FunctionDecl *,
+                 llvm::SmallVector<clang::QualType, 2>>
+      operator_parameter_types;
 
 public:
   RecordExposer(const clang::CXXRecordDecl *record_decl,
                 const DeclContextGraph &graph,
                 const AnnotationStorage &annotations,
+                QualifiedTypeNames &type_names, DeclTexts &texts,
                 RecordInliningPolicy inlining_policy);
 
   std::optional<RecordInliningPolicy> inliningPolicy() const override;
+  void prepareContext() override;
+  void prepareDecl(const clang::NamedDecl *decl) override;
   void emitParameter(llvm::raw_ostream &os) override;
   void emitIntroducer(llvm::raw_ostream &os,
                       llvm::StringRef parent_identifier) override;
@@ -136,9 +274,9 @@ private:
   void emitAggegateConstructor(llvm::raw_ostream &os);
   void emitOperator(llvm::raw_ostream &os, const clang::FunctionDecl *function);
   static void emitOperatorDefinition(
-      llvm::raw_ostream &os, const clang::ASTContext &ast_context,
-      clang::OverloadedOperatorKind kind,
-      const llvm::SmallVectorImpl<clang::QualType> &parameter_types,
+      llvm::raw_ostream &os, QualifiedTypeNames &type_names,
+      CodeMetrics &metrics, clang::OverloadedOperatorKind kind,
+      llvm::ArrayRef<clang::QualType> parameter_types,
       clang::QualType return_type, bool reverse_parameters);
   void emitType(llvm::raw_ostream &os);
   void handleDeclImpl(llvm::raw_ostream &os,
@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <clang/Basic/SourceLocation.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Regex.h>
+
+#include <optional>
+
+namespace clang {
+class Decl;
+class SourceManager;
+} // namespace clang
+
+namespace genpybind {
+
+/// Decides which headers are considered when looking for declarations to
+/// expose, s.t. the contents of all other headers can be pruned from the
+/// traversal of the AST and from name lookup in the global scope.
+///
+/// Declarations in system headers are never considered, as these cannot carry
+/// annotations.  If a pattern is provided, only headers whose path matches
+/// it are considered.  The main file is always considered.
+class HeaderFilter {
+  const clang::SourceManager &source_manager;
+  std::optional<llvm::Regex> pattern;
+  mutable llvm::DenseMap<clang::FileID, bool> skipped_files;
+
+public:
+  /// An empty `pattern` matches all headers.
+  explicit HeaderFilter(const clang::SourceManager &source_manager,
+                        llvm::StringRef pattern = {});
+
+  bool shouldSkip(const clang::Decl *decl) const;
+  bool shouldSkip(clang::SourceLocation loc) const;
+};
+
+} // namespace genpybind
@@ -4,43 +4,46 @@
 
 #pragma once
 
-#include <clang/AST/RecursiveASTVisitor.h>
-#include <clang/Sema/SemaConsumer.h>
+#include <llvm/ADT/ArrayRef.h>
+
+#include <vector>
 
 namespace clang {
-class ASTContext;
+class ClassTemplateSpecializationDecl;
+class FunctionDecl;
 class Sema;
-class Stmt;
-class ParmVarDecl;
+class TemplateInstantiationCallback;
 } // namespace clang
 
 namespace genpybind {
 
-/// Force default argument instantiation, s.t. the corresponding `Expr` node is
-/// present in the AST.  (This is normally done lazily when gathering arguments
-/// at the call site.)
-class InstantiateDefaultArgumentsASTConsumer
-    : public clang::SemaConsumer,
-      public clang::RecursiveASTVisitor<
-          InstantiateDefaultArgumentsASTConsumer> {
-  clang::Sema *sema = nullptr;
+/// Force default argument instantiation for the parameters of `function`,
+/// s.t. the corresponding `Expr` nodes are present in the AST.  (This is
+/// normally done lazily when gathering arguments at the call site.)
+/// As this can be costly, it should only be done for exposed functions.
+void instantiateDefaultArguments(clang::Sema &sema,
+                                 const clang::FunctionDecl *function);
+
+/// Records the class template specializations that are instantiated while an
+/// instance is alive.  As default arguments are only instantiated after the
+/// declaration context graph has been built, specializations that are first
+/// instantiated by them cannot be exposed anymore and need to be diagnosed.
+class InstantiatedSpecializations {
+  clang::Sema &sema;
+  const clang::TemplateInstantiationCallback *callback;
+  std::vector<const clang::ClassTemplateSpecializationDecl *> specializations;
 
 public:
-  void InitializeSema(clang::Sema &sema_) override { sema = &sema_; }
-  void ForgetSema() override { sema = nullptr; }
-
-  void HandleTranslationUnit(clang::ASTContext &context) override;
-
-  bool shouldWalkTypesOfTypeLocs() const { return false; }
-  bool shouldVisitTemplateInstantiations() const { return true; }
-  bool shouldVisitImplicitCode() const { return false; }
-
-  bool TraverseStmt(clang::Stmt *) {
-    // Do not visit statements and expressions.
-    return true;
+  explicit InstantiatedSpecializations(clang::Sema &sema);
+  ~InstantiatedSpecializations();
+  InstantiatedSpecializations(const InstantiatedSpecializations &) = delete;
+  InstantiatedSpecializations &
+  operator=(const InstantiatedSpecializations &) = delete;
+
+  /// Return the specializations instantiated so far, in order.
+  llvm::ArrayRef<const clang::ClassTemplateSpecializationDecl *> get() const {
+    return specializations;
   }
-
-  bool VisitParmVarDecl(clang::ParmVarDecl *decl);
 };
 
 } // namespace genpybind
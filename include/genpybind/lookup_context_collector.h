@@ -5,16 +5,23 @@
 #pragma once
 
 #include "genpybind/annotated_decl.h"
+#include "genpybind/header_filter.h"
 
 #include <clang/AST/Decl.h>
+#include <clang/AST/DeclTemplate.h>
 #include <clang/AST/RecursiveASTVisitor.h>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SetVector.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/Casting.h>
 
+#include <queue>
+#include <utility>
 #include <vector>
 
 namespace clang {
+class Sema;
 class Stmt;
 } // namespace clang
 
@@ -32,22 +39,76 @@ namespace genpybind {
 /// declarations are already extracted on this first pass through the AST.
 ///
 /// Only non-dependent contexts are considered, as only complete types can be
-/// exposed in any case.  As a preparation, `InstantiateAliasTargetsASTConsumer`
-/// should have been run, s.t. there is a complete record declaration
+/// exposed in any case.  If a `Sema` instance is provided, `collect` also
+/// prepares the AST on the same traversal, by instantiating annotated class
+/// template specializations (see `instantiateAnnotatedSpecialization`).
+/// Instantiated specializations are traversed afterwards using a worklist,
+/// s.t. there is a complete record declaration
 /// (`ClassTemplateSpecializationDecl`) for each referenced template
 /// instantiation.
+///
+/// If a `HeaderFilter` is provided, top-level declarations in headers that are
+/// not considered are pruned from the traversal.  Declaration contexts in such
+/// headers that are the target of an annotated alias (e.g., for `expose_here`)
+/// are traversed afterwards, as are instantiations of their templates.
 class LookupContextCollector
     : public clang::RecursiveASTVisitor<LookupContextCollector> {
   AnnotationStorage &annotations;
+  clang::Sema *sema;
+  const HeaderFilter *header_filter;
   llvm::DenseMap<const clang::NamedDecl *, const clang::NamedDecl *>
       first_decls;
+  /// Whether lookup contexts and annotations are collected, which is not the
+  /// case within implementation namespaces (see `shouldSkip`).
+  bool collecting = true;
+  /// Whether annotated specializations are queued for instantiation, which is
+  /// only done for the initial traversal and instantiated specializations.
+  bool queueing = true;
+  bool saw_annotation_errors = false;
+  std::queue<clang::ClassTemplateSpecializationDecl *> pending;
+  llvm::DenseSet<const clang::ClassTemplateSpecializationDecl *> done;
+  /// Alias targets whose declaration has been pruned by the header filter.
+  llvm::SetVector<clang::TagDecl *> filtered_alias_targets;
+  /// Traversed class templates and the specializations that were complete
+  /// when visited, in order to find specializations that have only been
+  /// instantiated later on (e.g., as base classes of instantiations).
+  llvm::SetVector<clang::ClassTemplateDecl *> class_templates;
+  llvm::DenseSet<const clang::ClassTemplateSpecializationDecl *>
+      visited_specializations;
+  /// Caches the result of `hasAnnotations` for the most recently visited
+  /// declaration, which is queried by several `Visit*` methods.
+  const clang::Decl *last_checked_decl = nullptr;
+  bool last_checked_has_annotations = false;
+
+  bool isAnnotated(const clang::Decl *decl) {
+    if (decl != last_checked_decl) {
+      last_checked_decl = decl;
+      last_checked_has_annotations = hasAnnotations(decl);
+    }
+    return last_checked_has_annotations;
+  }
+
+  void insertAnnotations(const clang::NamedDecl *decl);
+  void queueSpecialization(clang::ClassTemplateSpecializationDecl *decl);
+  void traverseDeferred(clang::Decl *decl, bool queue_specializations);
+  bool traverseLateSpecializations();
+  void removeDuplicates();
 
 public:
   std::vector<const clang::DeclContext *> lookup_contexts;
   std::vector<const clang::TypedefNameDecl *> aliases;
 
-  LookupContextCollector(AnnotationStorage &annotations)
-      : annotations(annotations) {}
+  LookupContextCollector(AnnotationStorage &annotations,
+                         clang::Sema *sema = nullptr,
+                         const HeaderFilter *header_filter = nullptr)
+      : annotations(annotations), sema(sema), header_filter(header_filter) {}
+
+  /// Traverse the translation unit and all specializations instantiated in the
+  /// process.
+  void collect(clang::TranslationUnitDecl *decl);
+
+  /// Whether errors have been reported while processing annotations.
+  bool hasAnnotationErrors() const { return saw_annotation_errors; }
 
   static bool shouldWalkTypesOfTypeLocs() { return false; }
   static bool shouldVisitTemplateInstantiations() { return true; }
@@ -58,6 +119,17 @@ public:
     return true;
   }
 
+  bool TraverseDecl(clang::Decl *decl) {
+    // Nested declarations are located in the same header as their parent, so
+    // it is sufficient to check the members of namespaces.
+    if (header_filter != nullptr && decl != nullptr &&
+        decl->getDeclContext() != nullptr &&
+        decl->getDeclContext()->isFileContext() &&
+        header_filter->shouldSkip(decl))
+      return true;
+    return RecursiveASTVisitor::TraverseDecl(decl);
+  }
+
   static bool shouldSkip(const clang::Decl *decl) {
     return shouldSkip(llvm::dyn_cast<clang::TagDecl>(decl)) ||
            shouldSkip(llvm::dyn_cast<clang::NamespaceDecl>(decl));
@@ -78,10 +150,10 @@ public:
   bool VisitNamedDecl(const clang::NamedDecl *decl) {
     // Collect all annotated declarations, such that annotation errors are
     // reported in the correct order.
-    if (shouldSkip(llvm::dyn_cast<clang::TagDecl>(decl)) ||
-        decl->getDeclContext()->isDependentContext() || !hasAnnotations(decl))
+    if (!collecting || shouldSkip(llvm::dyn_cast<clang::TagDecl>(decl)) ||
+        decl->getDeclContext()->isDependentContext() || !isAnnotated(decl))
       return true;
-    annotations.insert(decl);
+    insertAnnotations(decl);
     return true;
   }
 
@@ -89,22 +161,26 @@ public:
 
   void errorIfAnnotationsDoNotMatchFirstDecl(const clang::NamedDecl *decl);
 
-  bool VisitTypedefNameDecl(const clang::TypedefNameDecl *decl) {
-    // Only typedefs with explicit annotations are considered.
-    if (!hasAnnotations(decl) || decl->getDeclContext()->isDependentContext())
-      return true;
-    warnIfAliasHasQualifiers(decl);
-    aliases.push_back(decl);
-    return true;
-  }
+  bool VisitTypedefNameDecl(const clang::TypedefNameDecl *decl);
+  bool VisitClassTemplateSpecializationDecl(
+      clang::ClassTemplateSpecializationDecl *decl);
+  bool TraverseClassTemplateDecl(clang::ClassTemplateDecl *decl);
 
   bool TraverseNamespaceDecl(clang::NamespaceDecl *decl) {
-    if (shouldSkip(decl))
-      return true;
+    if (shouldSkip(decl)) {
+      // Implementation namespaces do not contribute any lookup contexts, but
+      // still need to be prepared.
+      if (sema == nullptr)
+        return true;
+      const bool was_collecting = std::exchange(collecting, false);
+      bool result = RecursiveASTVisitor::TraverseNamespaceDecl(decl);
+      collecting = was_collecting;
+      return result;
+    }
     auto before_traversing = annotations.size();
     bool result = RecursiveASTVisitor::TraverseNamespaceDecl(decl);
     bool saw_annotated_decls = annotations.size() != before_traversing;
-    if (saw_annotated_decls) {
+    if (collecting && saw_annotated_decls) {
       // Only check annotations for namespaces that either are annotated
       // themselves or that contain annotated decls.  Other namespaces are
       // pruned in any case and enforcing them to have annotations would only
@@ -115,14 +191,14 @@ public:
   }
 
   bool VisitNamespaceDecl(const clang::NamespaceDecl *decl) {
-    if (shouldSkip(decl))
+    if (!collecting || shouldSkip(decl))
       return true;
     lookup_contexts.push_back(decl);
     return true;
   }
 
   bool VisitTagDecl(const clang::TagDecl *decl) {
-    if (shouldSkip(decl))
+    if (!collecting || shouldSkip(decl))
       return true;
     lookup_contexts.push_back(decl);
     return true;
@@ -15,6 +15,18 @@ enum class Experiment {
 };
 bool isEnabled(Experiment experiment);
 
+/// How the members of annotated class template specializations are
+/// instantiated.
+enum class MemberInstantiation {
+  /// All members, including member function bodies, as for an explicit
+  /// instantiation definition.
+  All,
+  /// Only the declarations of members, plus the definitions of member classes
+  /// and enumerations and of functions whose return type is deduced.
+  Declarations,
+};
+MemberInstantiation getMemberInstantiation();
+
 llvm::cl::OptionCategory &getGenpybindCategory();
 
 } // namespace genpybind
@@ -0,0 +1,63 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <clang/Frontend/FrontendAction.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <string>
+#include <utility>
+
+namespace genpybind {
+
+/// Computes a key for the `OutputCache` from the preprocessed input, the
+/// compiler invocation and `salt`, which is expected to cover all further
+/// inputs (e.g., the tool version and options).  No AST is built.
+///
+/// Comments are part of the key, as they are used for docstrings.  Note that
+/// in preprocessor-only mode the original header of a precompiled header is
+/// lexed instead, so it is covered as well.
+/// The resulting key is appended to `key`, i.e., if a file is processed using
+/// several compile commands, all of them are taken into account.
+class CacheKeyAction : public clang::PreprocessorFrontendAction {
+  std::string salt;
+  std::string &key;
+
+public:
+  CacheKeyAction(std::string salt, std::string &key)
+      : salt(std::move(salt)), key(key) {}
+
+protected:
+  void ExecuteAction() override;
+};
+
+/// Returns whether the file at `path` exists and consists of exactly
+/// `contents`.  Used to leave unchanged output files untouched, s.t. their
+/// timestamps do not trigger a rebuild of the generated code.
+bool fileHasContents(llvm::StringRef path, llvm::StringRef contents);
+
+/// On-disk cache of generated bindings, where each entry contains a copy of
+/// all output files for a given key.
+class OutputCache {
+  std::string directory;
+
+public:
+  explicit OutputCache(std::string directory)
+      : directory(std::move(directory)) {}
+
+  /// Copy the cached output files for `key` to `output_paths` and return
+  /// whether this was successful.  Output files that already have the cached
+  /// contents are not modified.
+  bool restore(llvm::StringRef key,
+               llvm::ArrayRef<std::string> output_paths) const;
+
+  /// Add copies of the output files to the cache.  Failures are ignored, as
+  /// the cache is only an optimization.
+  void store(llvm::StringRef key,
+             llvm::ArrayRef<std::string> output_paths) const;
+};
+
+} // namespace genpybind
@@ -0,0 +1,112 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace genpybind {
+
+enum class ShardAssignment {
+  /// Balance the estimated compile cost of all shards.
+  Cost,
+  /// Place each item based on a stable hash of its name, s.t. adding or
+  /// removing items does not move unrelated items to different shards.
+  Hash,
+};
+
+/// Options that control how the generated code is spread over several
+/// output files ("shards").
+struct ShardingOptions {
+  /// If non-zero, only as many of the output files are used as necessary for
+  /// each to have an estimated compile cost of about this value.
+  std::uint64_t cost_target = 0;
+  /// If non-zero, the declarations of a context whose estimated compile cost
+  /// exceeds this value are spread over several `expose_` functions, which can
+  /// be placed in different shards.
+  std::uint64_t max_context_cost = 0;
+  ShardAssignment assignment = ShardAssignment::Cost;
+  /// Only the contexts assigned to this partition (out of `num_partitions`)
+  /// are rendered, s.t. the work can be spread over several processes.  The
+  /// module definition is emitted by the first partition.
+  unsigned partition = 0;
+  unsigned num_partitions = 1;
+};
+
+/// Parse a partition specification of the form `<index>/<count>`, where
+/// `index` is in the range [0, `count`).  Returns whether this was successful.
+bool parsePartition(llvm::StringRef spec, unsigned &index, unsigned &count);
+
+/// Counts of the constructs in generated code that dominate its compile time.
+/// These are recorded by the exposers while rendering the code.
+struct CodeMetrics {
+  /// Calls to `def` and its variants (e.g., `def_readwrite`).
+  std::uint64_t defs = 0;
+  /// Enumerators added via `value`.
+  std::uint64_t values = 0;
+  std::uint64_t lambdas = 0;
+  std::uint64_t overload_casts = 0;
+  std::uint64_t implicit_conversions = 0;
+  /// Instantiations of pybind11's wrapper class templates.
+  std::uint64_t wrappers = 0;
+  std::uint64_t bytes = 0;
+  /// Distinct signatures of function pointers, constructors and lambdas,
+  /// including their return type and qualifiers (sorted).
+  std::vector<std::string> signatures;
+
+  void addSignature(std::string signature);
+  CodeMetrics &operator+=(const CodeMetrics &other);
+  friend bool operator==(const CodeMetrics &, const CodeMetrics &) = default;
+};
+
+/// Estimate the cost of compiling code with the given metrics.  This is based
+/// on the number of `def` calls, distinct function signatures, lambdas (as
+/// used for operators) and instantiations of pybind11's wrapper class
+/// templates.  The unit is arbitrary, but costs of different snippets are
+/// comparable.
+std::uint64_t estimateCompileCost(const CodeMetrics &metrics);
+
+/// Return the number of shards necessary for the cost of each shard to stay
+/// below `cost_target`, clamped to the range [1, `max_shards`].
+unsigned shardCountForCostTarget(std::uint64_t total_cost,
+                                 std::uint64_t cost_target,
+                                 unsigned max_shards);
+
+/// Split a sequence of items with the given costs into consecutive parts,
+/// each with a total cost of at most `max_cost` (unless a single item is more
+/// expensive).  Returns the index of the first item of each part, i.e., the
+/// result is never empty.
+std::vector<std::size_t> splitAtCostLimit(llvm::ArrayRef<std::uint64_t> costs,
+                                          std::uint64_t max_cost);
+
+/// Assign items with the given costs to `num_shards` shards, s.t. the total
+/// cost of the most expensive shard is small.  The first shard is assumed to
+/// already carry `first_shard_cost`.  Returns the shard index of each item.
+/// The result only depends on the costs, i.e., it is deterministic.
+std::vector<unsigned> balanceShards(llvm::ArrayRef<std::uint64_t> costs,
+                                    unsigned num_shards,
+                                    std::uint64_t first_shard_cost = 0);
+
+/// Assign items to `num_shards` shards based on a stable hash of their `keys`.
+/// A consistent hash is used, s.t. changing the number of shards (e.g., due to
+/// `ShardingOptions::cost_target`) only moves about 1 / `num_shards` of the
+/// items.  To bound the imbalance, an item is placed on the next shard (in
+/// cyclic order) if it would push its shard's total cost above `1 + slack`
+/// times the average.  As this limit grows with the total cost, items that
+/// overflowed their shard can move when other items are added or become more
+/// expensive; all other items stay in place.  The first shard is assumed to
+/// already carry `first_shard_cost`.  Returns the shard index of each item.
+std::vector<unsigned> hashShards(llvm::ArrayRef<llvm::StringRef> keys,
+                                 llvm::ArrayRef<std::uint64_t> costs,
+                                 unsigned num_shards,
+                                 std::uint64_t first_shard_cost = 0,
+                                 double slack = 0.25);
+
+} // namespace genpybind
@@ -0,0 +1,83 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/JSON.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace genpybind {
+
+/// Counters describing the generation of a single module, which are written
+/// as JSON when using `--print-stats`.
+struct ModuleStatistics {
+  std::string header;
+  std::string module_name;
+  /// Whether the outputs have been restored from the cache, in which case
+  /// no other statistics are recorded.
+  bool cached = false;
+  /// Annotated template specializations that have been instantiated.
+  std::uint64_t instantiated_specializations = 0;
+  /// Declarations with parsed annotations.
+  std::uint64_t annotated_decls = 0;
+  std::uint64_t graph_nodes = 0;
+  std::uint64_t pruned_graph_nodes = 0;
+  /// Lookup contexts, i.e., contexts with an `expose_` function.
+  std::uint64_t contexts = 0;
+  /// Declarations found by name lookup in any of the contexts.
+  std::uint64_t visited_decls = 0;
+  /// Distinct function names per context, i.e., Python-level functions.
+  std::uint64_t functions = 0;
+  /// Bound C++ functions, including constructors and operators.
+  std::uint64_t overloads = 0;
+  /// Lambdas generated to expose operators.
+  std::uint64_t operator_lambdas = 0;
+  std::vector<std::uint64_t> output_bytes;
+  /// Wall-clock time in seconds spent in each phase (see `PhaseTimer`).
+  std::map<std::string, double> phase_seconds;
+};
+
+llvm::json::Value toJSON(const ModuleStatistics &statistics);
+
+/// Return the statistics of the module processed by the current thread, or
+/// `nullptr` if statistics are not collected.
+ModuleStatistics *currentStatistics();
+
+/// Makes `statistics` the result of `currentStatistics` on the current thread
+/// for the lifetime of this object.
+class StatisticsScope {
+  ModuleStatistics *previous;
+
+public:
+  explicit StatisticsScope(ModuleStatistics *statistics);
+  ~StatisticsScope();
+  StatisticsScope(const StatisticsScope &) = delete;
+  StatisticsScope &operator=(const StatisticsScope &) = delete;
+};
+
+/// Adds the time until destruction of this object to the given phase of the
+/// current statistics, if any.
+class PhaseTimer {
+  ModuleStatistics *statistics;
+  llvm::StringRef phase;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  explicit PhaseTimer(llvm::StringRef phase);
+  ~PhaseTimer();
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+};
+
+/// Return the peak resident set size of the process in bytes, or zero if
+/// this is not supported on the current platform.
+std::uint64_t getPeakMemoryUsage();
+
+} // namespace genpybind
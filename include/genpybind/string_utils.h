@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/StringRef.h>
 
+#include <string>
+
 namespace llvm {
 template <typename T> class SmallVectorImpl;
 } // namespace llvm
@@ -19,4 +22,12 @@ bool isValidIdentifier(llvm::StringRef name);
 /// single underscores.
 void makeValidIdentifier(llvm::SmallVectorImpl<char> &name);
 
+/// Makes identifiers unique by appending a numeric suffix to repeated names.
+class DiscriminateIdentifiers {
+  llvm::StringMap<unsigned> discriminators;
+
+public:
+  std::string discriminate(llvm::StringRef name);
+};
+
 } // namespace genpybind
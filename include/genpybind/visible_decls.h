@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
 
+#include <deque>
 #include <optional>
 #include <vector>
 
@@ -19,6 +22,7 @@ class TagDecl;
 
 namespace genpybind {
 class AnnotationStorage;
+class HeaderFilter;
 
 /// A set of base classes whose declarations should be "inlined" into
 /// a given record.  There has to be a path with public access from
@@ -45,6 +49,8 @@ public:
   bool shouldInline(const clang::TagDecl *decl) const;
   bool shouldHide(const clang::TagDecl *decl) const;
 
+  bool operator==(const RecordInliningPolicy &other) const;
+
 private:
   BaseSet inline_bases;
   BaseSet hide_bases;
@@ -56,8 +62,41 @@ private:
 /// are considered.
 /// Optionally specify an `inlining_policy` that describes whether visible
 /// declarations inherited from base classes should be included.
+/// If a `header_filter` is given, declarations found in the global scope are
+/// only included if their header is considered.
 std::vector<const clang::NamedDecl *> collectVisibleDeclsFromDeclContext(
     clang::Sema &sema, const clang::DeclContext *decl_context,
-    std::optional<RecordInliningPolicy> inlining_policy = std::nullopt);
+    std::optional<RecordInliningPolicy> inlining_policy = std::nullopt,
+    const HeaderFilter *header_filter = nullptr);
+
+/// Memoizes `collectVisibleDeclsFromDeclContext` per primary context and
+/// inlining policy.  Each re-opened namespace is represented by a separate
+/// node in the decl context graph, while name lookup always covers all of its
+/// declarations.  Sharing this cache between the different phases thus
+/// ensures that each namespace is looked up only once.
+class VisibleDeclsCache {
+  struct Entry {
+    std::optional<RecordInliningPolicy> inlining_policy;
+    std::vector<const clang::NamedDecl *> decls;
+  };
+
+  clang::Sema &sema;
+  const HeaderFilter *header_filter;
+  std::deque<Entry> storage; // provides stable references
+  llvm::DenseMap<const clang::DeclContext *, llvm::SmallVector<Entry *, 1>>
+      entries;
+
+public:
+  explicit VisibleDeclsCache(clang::Sema &sema,
+                             const HeaderFilter *header_filter = nullptr)
+      : sema(sema), header_filter(header_filter) {}
+
+  /// See `collectVisibleDeclsFromDeclContext`.  The returned reference stays
+  /// valid for the lifetime of the cache.
+  const std::vector<const clang::NamedDecl *> &
+  get(const clang::DeclContext *decl_context,
+      const std::optional<RecordInliningPolicy> &inlining_policy =
+          std::nullopt);
+};
 
 } // namespace genpybind
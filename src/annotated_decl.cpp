@@ -35,7 +35,6 @@
 #include <llvm/Support/raw_ostream.h>
 
 #include <cassert>
-#include <functional>
 #include <iterator>
 #include <string>
 #include <tuple>
@@ -544,7 +543,7 @@ void genpybind::propagateAnnotations(AnnotationStorage &annotations,
   // Ensure that any annotations on the target itself have been processed.
   assert(annotations.has(target_decl));
 
-  const auto attrs = annotations.lookup<NamedDeclAttrs>(decl);
+  const auto &attrs = annotations.lookup<NamedDeclAttrs>(decl);
   annotations.update<NamedDeclAttrs>(target_decl, [&](auto &target_attrs) {
     // Always propagate the effective spelling of the type alias, which is the
     // name of its identifier if no explicit `expose_as` annotation has been
@@ -896,33 +895,40 @@ void AnnotationStorage::insert(const clang::NamedDecl *decl) {
   if (has(decl))
     return;
 
-  std::vector<std::function<bool(const Annotation &)>> handlers;
+  // Attributes of all kinds that apply to this declaration are created
+  // up-front, such that they are present even if empty.
+  Entry &entry = entries[decl];
   std::apply(
-      [&](auto &...map) {
-        ((llvm::remove_cvref_t<decltype(map)>::mapped_type::supports(decl)
-              ? handlers.push_back(
-                    [decl, &attrs = map[decl]](const Annotation &annotation) {
-                      return processAnnotation(decl, annotation, attrs);
-                    })
+      [&](auto *&...attrs) {
+        ((attrs == nullptr &&
+                  llvm::remove_cvref_t<decltype(*attrs)>::supports(decl)
+              ? void(attrs = create<llvm::remove_cvref_t<decltype(*attrs)>>())
               : void()),
          ...);
       },
-      attrs_by_decl);
+      entry);
+  // Copied, as the map may grow while processing annotations.
+  const Entry attrs_of_decl = entry;
 
   // Non-namespace named decls that have at least one annotation
   // are visible by default.  This can be overruled by an explicit
   // `visible(default)`, `visible(false)` or `hidden` annotation.
   if (!llvm::isa<clang::NamespaceDecl>(decl) &&
       hasAnnotations(decl, /*allow_empty=*/false)) {
-    std::get<Map<NamedDeclAttrs>>(attrs_by_decl)[decl].visible = true;
+    std::get<NamedDeclAttrs *>(attrs_of_decl)->visible = true;
   }
 
   clang::DiagnosticsEngine &diag = decl->getASTContext().getDiagnostics();
   const Parser::Annotations annotations = parseAnnotations(decl);
   for (const Annotation &annotation : annotations) {
     clang::DiagnosticErrorTrap trap{diag};
-    bool handled = llvm::any_of(
-        handlers, [&](const auto &handler) { return handler(annotation); });
+    bool handled = std::apply(
+        [&](auto *...attrs) {
+          return ((attrs != nullptr &&
+                   processAnnotation(decl, annotation, *attrs)) ||
+                  ...);
+        },
+        attrs_of_decl);
     if (!trap.hasErrorOccurred() && !handled) {
       reportInvalidAnnotationError(decl, annotation);
     }
@@ -931,11 +937,17 @@ void AnnotationStorage::insert(const clang::NamedDecl *decl) {
 
 bool AnnotationStorage::equal(const clang::NamedDecl *left,
                               const clang::NamedDecl *right) const {
+  static const Entry missing{};
+  auto left_it = entries.find(left);
+  auto right_it = entries.find(right);
+  const Entry &lhs = left_it != entries.end() ? left_it->second : missing;
+  const Entry &rhs = right_it != entries.end() ? right_it->second : missing;
   return std::apply(
-      [&](auto... x) {
-        return (
-            (this->get<decltype(x)>(left) == this->get<decltype(x)>(right)) &&
-            ...);
+      [&](auto *...x) {
+        return ([](const auto *l, const auto *r) {
+          return l == nullptr || r == nullptr ? l == r : *l == *r;
+        }(x, std::get<decltype(x)>(rhs)) &&
+                ...);
       },
-      AttrTypes{});
+      lhs);
 }
@@ -0,0 +1,314 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "genpybind/bindings.h"
+
+#include "genpybind/string_utils.h"
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/Sequence.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+
+using namespace genpybind;
+
+llvm::json::Value genpybind::toJSON(const CodeMetrics &metrics) {
+  return llvm::json::Object{
+      {"defs", metrics.defs},
+      {"values", metrics.values},
+      {"lambdas", metrics.lambdas},
+      {"overload_casts", metrics.overload_casts},
+      {"implicit_conversions", metrics.implicit_conversions},
+      {"wrappers", metrics.wrappers},
+      {"bytes", metrics.bytes},
+      {"signatures", metrics.signatures},
+  };
+}
+
+bool genpybind::fromJSON(const llvm::json::Value &value, CodeMetrics &metrics,
+                         llvm::json::Path path) {
+  llvm::json::ObjectMapper mapper(value, path);
+  return mapper && mapper.map("defs", metrics.defs) &&
+         mapper.map("values", metrics.values) &&
+         mapper.map("lambdas", metrics.lambdas) &&
+         mapper.map("overload_casts", metrics.overload_casts) &&
+         mapper.map("implicit_conversions", metrics.implicit_conversions) &&
+         mapper.map("wrappers", metrics.wrappers) &&
+         mapper.map("bytes", metrics.bytes) &&
+         mapper.map("signatures", metrics.signatures);
+}
+
+llvm::json::Value genpybind::toJSON(const RenderedCode &rendered) {
+  return llvm::json::Object{
+      {"code", rendered.code},
+      {"metrics", rendered.metrics},
+  };
+}
+
+bool genpybind::fromJSON(const llvm::json::Value &value, RenderedCode &rendered,
+                         llvm::json::Path path) {
+  llvm::json::ObjectMapper mapper(value, path);
+  return mapper && mapper.map("code", rendered.code) &&
+         mapper.map("metrics", rendered.metrics);
+}
+
+llvm::json::Value genpybind::toJSON(const ContextBindings &context) {
+  return llvm::json::Object{
+      {"identifier", context.identifier},
+      {"parameter", context.parameter},
+      {"introducer", context.introducer},
+      {"declarations", context.declarations},
+      {"finalization", context.finalization},
+      {"rendered", context.is_rendered},
+  };
+}
+
+bool genpybind::fromJSON(const llvm::json::Value &value,
+                         ContextBindings &context, llvm::json::Path path) {
+  llvm::json::ObjectMapper mapper(value, path);
+  return mapper && mapper.map("identifier", context.identifier) &&
+         mapper.map("parameter", context.parameter) &&
+         mapper.map("introducer", context.introducer) &&
+         mapper.map("declarations", context.declarations) &&
+         mapper.map("finalization", context.finalization) &&
+         mapper.map("rendered", context.is_rendered);
+}
+
+llvm::json::Value genpybind::toJSON(const ModuleBindings &module) {
+  return llvm::json::Object{
+      {"version", ModuleBindings::version},
+      {"module", module.module_name},
+      {"includes", module.includes},
+      {"contexts", module.contexts},
+      {"postamble", module.postamble},
+  };
+}
+
+bool genpybind::fromJSON(const llvm::json::Value &value, ModuleBindings &module,
+                         llvm::json::Path path) {
+  llvm::json::ObjectMapper mapper(value, path);
+  std::int64_t version = 0;
+  if (!mapper || !mapper.map("version", version))
+    return false;
+  if (version != ModuleBindings::version) {
+    path.field("version").report("unsupported version");
+    return false;
+  }
+  return mapper.map("module", module.module_name) &&
+         mapper.map("includes", module.includes) &&
+         mapper.map("contexts", module.contexts) &&
+         mapper.map("postamble", module.postamble);
+}
+
+void genpybind::emitBindings(const ModuleBindings &module,
+                             std::vector<llvm::raw_ostream *> ostreams,
+                             const ShardingOptions &sharding) {
+  assert(!ostreams.empty());
+
+  // The declarations of a context may be spread over several `expose_`
+  // functions ("parts"), which are called in order from the module definition.
+  // The definition is empty for contexts rendered by other partitions.
+  struct ExposeFunction {
+    const ContextBindings *context;
+    std::string identifier;
+    std::string definition;
+    CodeMetrics metrics;
+  };
+
+  auto emit_expose_declarator = [](llvm::raw_ostream &os,
+                                   const ExposeFunction &function) {
+    os << "void expose_" << function.identifier << "("
+       << function.context->parameter << ")";
+  };
+
+  DiscriminateIdentifiers used_identifiers;
+  for (const ContextBindings &context : module.contexts)
+    used_identifiers.discriminate(context.identifier);
+
+  std::vector<ExposeFunction> functions;
+  functions.reserve(module.contexts.size());
+  for (const ContextBindings &context : module.contexts) {
+    if (!context.is_rendered) {
+      functions.push_back({&context, context.identifier, "", {}});
+      continue;
+    }
+
+    std::vector<std::size_t> parts{0};
+    if (sharding.max_context_cost != 0) {
+      std::vector<std::uint64_t> costs;
+      costs.reserve(context.declarations.size());
+      for (const RenderedCode &declaration : context.declarations)
+        costs.push_back(estimateCompileCost(declaration.metrics));
+      parts = splitAtCostLimit(costs, sharding.max_context_cost);
+    }
+
+    for (auto part : llvm::seq<std::size_t>(0, parts.size())) {
+      const bool is_last = part + 1 == parts.size();
+      ExposeFunction &function = functions.emplace_back();
+      function.context = &context;
+      function.identifier =
+          parts.size() == 1
+              ? context.identifier
+              : used_identifiers.discriminate(
+                    (context.identifier + "_part" + llvm::Twine(part + 1))
+                        .str());
+
+      llvm::raw_string_ostream os(function.definition);
+      emit_expose_declarator(os, function);
+      os << " {\n";
+      const std::size_t end =
+          is_last ? context.declarations.size() : parts[part + 1];
+      for (auto declaration : llvm::seq<std::size_t>(parts[part], end)) {
+        os << context.declarations[declaration].code;
+        function.metrics += context.declarations[declaration].metrics;
+      }
+      if (is_last) {
+        os << context.finalization.code;
+        function.metrics += context.finalization.metrics;
+      }
+      os << "}\n\n";
+    }
+  }
+
+  // The module definition is always placed in the first output stream (of the
+  // first partition).
+  const bool has_module_definition = sharding.partition == 0;
+  std::string module_definition;
+  llvm::raw_string_ostream main_stream(module_definition);
+
+  // Emit declarations for `expose_` functions
+  for (const auto &function : functions) {
+    emit_expose_declarator(main_stream, function);
+    main_stream << ";\n";
+  }
+
+  main_stream << '\n';
+
+  // Emit module definition
+  main_stream << "PYBIND11_MODULE(" << module.module_name << ", root) {\n";
+
+  // Emit context introducers, which instantiate the wrapper class templates.
+  CodeMetrics module_metrics;
+  for (const auto &context : module.contexts) {
+    main_stream << "auto " << context.identifier << " = "
+                << context.introducer.code << ";\n";
+    module_metrics += context.introducer.metrics;
+  }
+
+  main_stream << '\n';
+
+  // Emit calls to `expose_` functions
+  for (const auto &function : functions) {
+    main_stream << "expose_" << function.identifier << "("
+                << function.context->identifier << ");\n";
+  }
+
+  main_stream << module.postamble;
+  main_stream << "}\n\n";
+
+  // Distribute the definitions to the different streams, balancing their
+  // estimated compile cost.
+  llvm::TimeTraceScope scope("AssignShards");
+  std::vector<const ExposeFunction *> rendered;
+  for (const ExposeFunction &function : functions) {
+    if (!function.definition.empty())
+      rendered.push_back(&function);
+  }
+  std::vector<std::uint64_t> costs;
+  costs.reserve(rendered.size());
+  for (const ExposeFunction *function : rendered)
+    costs.push_back(estimateCompileCost(function->metrics));
+  const std::uint64_t module_cost =
+      has_module_definition ? estimateCompileCost(module_metrics) : 0;
+
+  auto num_shards = static_cast<unsigned>(ostreams.size());
+  if (sharding.cost_target != 0) {
+    num_shards = shardCountForCostTarget(
+        std::accumulate(costs.begin(), costs.end(), module_cost),
+        sharding.cost_target, num_shards);
+  }
+  const std::vector<unsigned> shards = [&] {
+    switch (sharding.assignment) {
+    case ShardAssignment::Cost:
+      return balanceShards(costs, num_shards, module_cost);
+    case ShardAssignment::Hash: {
+      std::vector<llvm::StringRef> keys;
+      keys.reserve(rendered.size());
+      for (const ExposeFunction *function : rendered)
+        keys.push_back(function->identifier);
+      return hashShards(keys, costs, num_shards, module_cost);
+    }
+    }
+    llvm_unreachable("Unknown shard assignment.");
+  }();
+
+  for (auto shard : llvm::seq<unsigned>(0, ostreams.size())) {
+    llvm::raw_ostream &os = *ostreams[shard];
+    const bool has_declarations = shard == 0 && has_module_definition;
+    if (!has_declarations && !llvm::is_contained(shards, shard)) {
+      os << "// No bindings have been assigned to this file.\n";
+      continue;
+    }
+    os << module.includes;
+    if (has_declarations)
+      os << module_definition;
+    for (auto index : llvm::seq<std::size_t>(0, rendered.size())) {
+      if (shards[index] != shard)
+        continue;
+      // Also emit declaration to this stream, in order to avoid
+      // `-Wmissing-declarations` warnings.
+      if (!has_declarations) {
+        emit_expose_declarator(os, *rendered[index]);
+        os << ";\n";
+      }
+      os << rendered[index]->definition;
+    }
+  }
+}
+
+void genpybind::printCostReport(llvm::raw_ostream &os,
+                                const ModuleBindings &module) {
+  struct Entry {
+    const ContextBindings *context;
+    CodeMetrics metrics;
+    std::uint64_t cost;
+  };
+
+  std::vector<Entry> entries;
+  for (const ContextBindings &context : module.contexts) {
+    if (!context.is_rendered)
+      continue;
+    // The introducer is part of the module definition, but it is attributed
+    // to the context, as it instantiates the wrapper class template.
+    CodeMetrics metrics = context.introducer.metrics;
+    for (const RenderedCode &declaration : context.declarations)
+      metrics += declaration.metrics;
+    metrics += context.finalization.metrics;
+    entries.push_back({&context, metrics, estimateCompileCost(metrics)});
+  }
+  llvm::stable_sort(entries, [](const Entry &lhs, const Entry &rhs) {
+    return lhs.cost > rhs.cost;
+  });
+
+  os << llvm::formatv("{0,8} {1,6} {2,10} {3,7} {4,14} {5,11} {6,8}  {7}\n",
+                      "cost", "defs", "signatures", "lambdas",
+                      "overload_casts", "conversions", "bytes", "context");
+  for (const Entry &entry : entries) {
+    const CodeMetrics &metrics = entry.metrics;
+    os << llvm::formatv("{0,8} {1,6} {2,10} {3,7} {4,14} {5,11} {6,8}  {7}\n",
+                        entry.cost, metrics.defs, metrics.signatures.size(),
+                        metrics.lambdas, metrics.overload_casts,
+                        metrics.implicit_conversions, metrics.bytes,
+                        entry.context->identifier);
+  }
+}
@@ -46,19 +46,22 @@ bool DeclContextGraphBuilder::addEdgeForExposeHereAlias(
 }
 
 std::optional<DeclContextGraph> DeclContextGraphBuilder::buildGraph() {
-  clang::DiagnosticErrorTrap trap{
-      translation_unit->getASTContext().getDiagnostics()};
-  LookupContextCollector visitor(annotations);
-  visitor.TraverseDecl(translation_unit);
+  LookupContextCollector visitor(annotations, sema, header_filter);
+  visitor.collect(translation_unit);
 
   // Bail out if there were errors during the first traversal of the AST,
-  // e.g. due to invalid annotations.
-  if (trap.hasErrorOccurred())
+  // e.g. due to invalid annotations.  Errors on instantiated templates are
+  // reported by clang and do not prevent the remaining bindings from being
+  // generated.
+  if (visitor.hasAnnotationErrors())
     return std::nullopt;
 
+  clang::DiagnosticErrorTrap trap{
+      translation_unit->getASTContext().getDiagnostics()};
+
   for (const clang::TypedefNameDecl *alias_decl : visitor.aliases) {
     const auto attrs = annotations.get<TypedefNameDeclAttrs>(alias_decl);
-    assert(attrs.has_value());
+    assert(attrs != nullptr);
     if (!attrs->encourage && !attrs->expose_here)
       continue;
     const clang::TagDecl *target_decl = aliasTarget(alias_decl);
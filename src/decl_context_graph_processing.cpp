@@ -24,6 +24,7 @@
 
 #include <cassert>
 #include <queue>
+#include <utility>
 #include <vector>
 
 using namespace genpybind;
@@ -166,7 +167,7 @@ bool genpybind::reportExposeHereCycles(
 }
 
 ConstDeclContextSet genpybind::declContextsWithVisibleNamedDecls(
-    clang::Sema &sema, const DeclContextGraph *graph,
+    VisibleDeclsCache &visible_decls, const DeclContextGraph *graph,
     const AnnotationStorage &annotations,
     const EffectiveVisibilityMap &visibilities) {
   ConstDeclContextSet result;
@@ -190,6 +191,12 @@ ConstDeclContextSet genpybind::declContextsWithVisibleNamedDecls(
     });
   };
 
+  // The result for named decls only depends on the lookup context and the
+  // default visibility, which allows to skip most of the work for re-opened
+  // namespaces.
+  llvm::DenseMap<std::pair<const clang::DeclContext *, bool>, bool>
+      has_visible_named_decls;
+
   auto contains_visible_named_decls =
       [&](const DeclContextNode *const node) -> bool {
     const clang::DeclContext *const context = node->getDeclContext();
@@ -216,17 +223,22 @@ ConstDeclContextSet genpybind::declContextsWithVisibleNamedDecls(
     auto is_visible_given_default_visibility =
         [&](const clang::NamedDecl *decl) -> bool {
       if (const auto attrs = annotations.get<NamedDeclAttrs>(decl);
-          attrs.has_value() && attrs->visible.has_value()) {
+          attrs != nullptr && attrs->visible.has_value()) {
         return *attrs->visible;
       }
       // An unannotated declaration in a "visible" context should be preserved.
       return default_visibility;
     };
 
-    std::vector<const clang::NamedDecl *> decls =
-        collectVisibleDeclsFromDeclContext(sema, context);
+    auto [it, inserted] = has_visible_named_decls.try_emplace(
+        {context->getPrimaryContext(), default_visibility}, false);
+    if (!inserted)
+      return it->getSecond();
+
+    const std::vector<const clang::NamedDecl *> &decls =
+        visible_decls.get(context);
 
-    return llvm::any_of(decls, [&](const clang::NamedDecl *decl) {
+    it->getSecond() = llvm::any_of(decls, [&](const clang::NamedDecl *decl) {
       // Nested declaration contexts that are represented in the graph are taken
       // into account above.
       assert(!DeclContextGraph::accepts(decl));
@@ -238,6 +250,7 @@ ConstDeclContextSet genpybind::declContextsWithVisibleNamedDecls(
 
       return is_visible_given_default_visibility(decl);
     });
+    return it->getSecond();
   };
 
   // Visit the nodes in a post-order traversal, s.t. if a node is visited,
@@ -298,7 +311,7 @@ void genpybind::hideNamespacesBasedOnExposeInAnnotation(
       const auto *namespace_decl =
           llvm::dyn_cast<clang::NamespaceDecl>(it->getDecl());
       const auto attrs = annotations.get<NamespaceDeclAttrs>(namespace_decl);
-      return attrs.has_value() && !attrs->only_expose_in.empty() &&
+      return attrs != nullptr && !attrs->only_expose_in.empty() &&
              !llvm::any_of(attrs->only_expose_in, [&](llvm::StringRef name) {
                return name == module_name;
              });
@@ -90,6 +90,10 @@ static unsigned getCustomDiagID(clang::DiagnosticsEngine &engine,
   case Kind::PropertyHasNoGetterError:
     return engine.getCustomDiagID(clang::DiagnosticsEngine::Error,
                                   "No getter for the '%0' property");
+  case Kind::SpecializationInstantiatedByDefaultArgumentWarning:
+    return engine.getCustomDiagID(
+        clang::DiagnosticsEngine::Warning,
+        "'%0' is only instantiated by a default argument and thus not exposed");
   case Kind::TrailingParametersError:
     return engine.getCustomDiagID(clang::DiagnosticsEngine::Error,
                                   "cannot be followed by other parameters");
@@ -8,8 +8,11 @@
 #include "genpybind/decl_context_graph.h"
 #include "genpybind/decl_context_graph_processing.h"
 #include "genpybind/diagnostics.h"
+#include "genpybind/instantiate_default_arguments.h"
 #include "genpybind/options.h"
+#include "genpybind/shards.h"
 #include "genpybind/sort_decls.h"
+#include "genpybind/statistics.h"
 #include "genpybind/string_utils.h"
 #include "genpybind/visible_decls.h"
 
@@ -38,24 +41,30 @@
 #include <clang/Sema/Sema.h>
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/MapVector.h>
 #include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/Sequence.h>
 #include <llvm/ADT/SmallSet.h>
 #include <llvm/ADT/SmallString.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringExtras.h>
-#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/iterator.h>
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/TimeProfiler.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <initializer_list>
 #include <iterator>
+#include <mutex>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -63,20 +72,6 @@ using namespace genpybind;
 
 namespace {
 
-class DiscriminateIdentifiers {
-  llvm::StringMap<unsigned> discriminators;
-
-public:
-  std::string discriminate(llvm::StringRef name) {
-    auto it = discriminators.try_emplace(name, 0).first;
-    const unsigned discriminator = ++it->getValue();
-    std::string result{name};
-    if (discriminator != 1)
-      result += "_" + llvm::utostr(discriminator);
-    return result;
-  }
-};
-
 /// A very unprincipled attempt to print a default argument expression in
 /// a fully qualified way by augmenting and replicating the behavior/output of
 /// clang::Stmt::prettyPrint.
@@ -86,13 +81,14 @@ public:
 /// functions in `QualTypeNames.cpp` and parts of `TreeTransform.h`.
 /// TODO: If they are at some point, this hack should be replaced altogether.
 struct AttemptFullQualificationPrinter : clang::PrinterHelper {
+  QualifiedTypeNames &type_names;
   const clang::ASTContext &context;
-  clang::PrintingPolicy printing_policy;
+  const clang::PrintingPolicy &printing_policy;
   bool within_braced_initializer = false;
 
-  AttemptFullQualificationPrinter(const clang::ASTContext &context,
-                                  clang::PrintingPolicy printing_policy)
-      : context(context), printing_policy(printing_policy) {}
+  AttemptFullQualificationPrinter(QualifiedTypeNames &type_names)
+      : type_names(type_names), context(type_names.getASTContext()),
+        printing_policy(type_names.getPrintingPolicy()) {}
 
   bool handledStmt(clang::Stmt *stmt, llvm::raw_ostream &os) override {
     const auto *expr = llvm::dyn_cast<clang::Expr>(stmt);
@@ -120,9 +116,7 @@ struct AttemptFullQualificationPrinter : clang::PrinterHelper {
     if (should_prepend_qualified_type_to_braced_initializer) {
       // NOTE: For array types, e.g., `bool[2]`, this will not work, as
       // `bool[2]{…}` isn't valid.
-      os << clang::TypeName::getFullyQualifiedName(expr->getType(), context,
-                                                   printing_policy,
-                                                   /*WithGlobalNsPrefix=*/true);
+      os << type_names.get(expr->getType());
       within_braced_initializer = true;
       print_recursively(expr);
       within_braced_initializer = false;
@@ -153,9 +147,7 @@ struct AttemptFullQualificationPrinter : clang::PrinterHelper {
     // - AsTypeExpr
 
     auto print_fully_qualified_name = [&](clang::QualType qual_type) {
-      os << clang::TypeName::getFullyQualifiedName(qual_type, context,
-                                                   printing_policy,
-                                                   /*WithGlobalNsPrefix=*/true);
+      os << type_names.get(qual_type);
     };
 
     if (const auto *cast = llvm::dyn_cast<clang::CStyleCastExpr>(expr)) {
@@ -267,30 +259,19 @@ static void emitStringLiteral(llvm::raw_ostream &os, llvm::StringRef text) {
   os << '"';
 }
 
+/// Return the name under which `decl` is exposed on the Python side.
+static std::string getExposedName(const clang::NamedDecl *decl,
+                                  const NamedDeclAttrs &attrs,
+                                  llvm::StringRef fallback = {}) {
+  return !attrs.spelling.empty()
+             ? attrs.spelling
+             : (!fallback.empty() ? fallback.str() : getSpelling(decl));
+}
+
 static void emitSpelling(llvm::raw_ostream &os, const clang::NamedDecl *decl,
                          const NamedDeclAttrs &attrs,
                          llvm::StringRef fallback = {}) {
-  emitStringLiteral(
-      os, !attrs.spelling.empty()
-              ? attrs.spelling
-              : (!fallback.empty() ? fallback.str() : getSpelling(decl)));
-}
-
-static llvm::StringRef getBriefText(const clang::Decl *decl) {
-  const clang::ASTContext &context = decl->getASTContext();
-  if (const clang::RawComment *raw = context.getRawCommentForAnyRedecl(decl)) {
-    return raw->getBriefText(context);
-  }
-  return {};
-}
-
-static llvm::StringRef getDocstring(const clang::FunctionDecl *function) {
-  llvm::StringRef result = getBriefText(function);
-  if (result.empty())
-    if (const clang::FunctionTemplateDecl *primary =
-            function->getPrimaryTemplate())
-      result = getBriefText(primary);
-  return result;
+  emitStringLiteral(os, getExposedName(decl, attrs, fallback));
 }
 
 static clang::PrintingPolicy
@@ -303,20 +284,42 @@ getPrintingPolicyForExposedNames(const clang::ASTContext &context) {
 }
 
 static void emitParameterTypes(llvm::raw_ostream &os,
+                               QualifiedTypeNames &type_names,
                                const clang::FunctionDecl *function) {
-  const clang::ASTContext &context = function->getASTContext();
-  auto policy = getPrintingPolicyForExposedNames(context);
   bool comma = false;
   for (const clang::ParmVarDecl *param : function->parameters()) {
     if (comma)
       os << ", ";
-    os << clang::TypeName::getFullyQualifiedName(param->getOriginalType(),
-                                                 context, policy,
-                                                 /*WithGlobalNsPrefix=*/true);
+    os << type_names.get(param->getOriginalType());
     comma = true;
   }
 }
 
+/// Return the signature of `function` in the form of a function pointer type
+/// (or the constructed type for constructors), which determines the argument
+/// loaders and casters instantiated for its binding.
+static std::string getSignature(QualifiedTypeNames &type_names,
+                                const clang::FunctionDecl *function) {
+  std::string signature;
+  llvm::raw_string_ostream os(signature);
+  const auto *method = llvm::dyn_cast<clang::CXXMethodDecl>(function);
+  if (const auto *constructor =
+          llvm::dyn_cast<clang::CXXConstructorDecl>(function)) {
+    os << type_names.get(constructor->getParent());
+  } else {
+    os << type_names.get(function->getReturnType()) << " (";
+    if (method != nullptr && method->isImplicitObjectMemberFunction())
+      os << type_names.get(method->getParent()) << "::";
+    os << "*)";
+  }
+  os << '(';
+  emitParameterTypes(os, type_names, function);
+  os << ')';
+  if (method != nullptr && method->isConst())
+    os << " const";
+  return signature;
+}
+
 static llvm::StringRef getPybind11ArgsType(clang::QualType parameter_type) {
   static const clang::ast_matchers::internal::HasNameMatcher matcher(
       {"::pybind11::args", "::pybind11::kwargs"});
@@ -328,12 +331,11 @@ static llvm::StringRef getPybind11ArgsType(clang::QualType parameter_type) {
   return record->getName();
 }
 
-static void emitParameters(llvm::raw_ostream &os,
-                           const clang::FunctionDecl *function,
-                           const FunctionDeclAttrs &attrs) {
-  const clang::ASTContext &context = function->getASTContext();
-  auto printing_policy = getPrintingPolicyForExposedNames(context);
-  AttemptFullQualificationPrinter printer_helper{context, printing_policy};
+static void
+emitParameters(llvm::raw_ostream &os, DeclTexts &texts,
+               DeclContextExposer::PendingDiagnostics &diagnostics,
+               const clang::FunctionDecl *function,
+               const FunctionDeclAttrs &attrs) {
   unsigned index = 0;
   const clang::ParmVarDecl *last_kwargs_param = nullptr;
   for (const clang::ParmVarDecl *param : function->parameters()) {
@@ -352,8 +354,10 @@ static void emitParameters(llvm::raw_ostream &os,
       continue;
     }
     if (last_kwargs_param != nullptr) {
-      Diagnostics::report(last_kwargs_param,
-                          Diagnostics::Kind::TrailingParametersError);
+      diagnostics.push_back([last_kwargs_param] {
+        Diagnostics::report(last_kwargs_param,
+                            Diagnostics::Kind::TrailingParametersError);
+      });
       break;
     }
     os << ", ::pybind11::arg(";
@@ -363,11 +367,9 @@ static void emitParameters(llvm::raw_ostream &os,
       os << ".noconvert()";
     if (attrs.required.count(index) != 0)
       os << ".none(false)";
-    if (const clang::Expr *expr = param->getDefaultArg()) {
-      os << " = ";
-      expr->printPretty(os, &printer_helper, printing_policy, /*Indentation=*/0,
-                        /*NewlineSymbol=*/"\n", &context);
-    }
+    if (llvm::StringRef initializer = texts.getInitializer(param);
+        !initializer.empty())
+      os << " = " << initializer;
     ++index;
   }
 }
@@ -383,12 +385,16 @@ static void emitPolicies(llvm::raw_ostream &os,
 }
 
 static void emitFunctionPointer(llvm::raw_ostream &os,
+                                QualifiedTypeNames &type_names,
+                                CodeMetrics &metrics,
                                 const clang::FunctionDecl *function) {
   // TODO: All names need to be printed in a fully-qualified way (also nested
   // template arguments)
-  auto policy = getPrintingPolicyForExposedNames(function->getASTContext());
+  const clang::PrintingPolicy &policy = type_names.getPrintingPolicy();
+  ++metrics.overload_casts;
+  metrics.addSignature(getSignature(type_names, function));
   os << "::pybind11::overload_cast<";
-  emitParameterTypes(os, function);
+  emitParameterTypes(os, type_names, function);
   os << ">(&::";
   function->printQualifiedName(os, policy);
   if (const clang::TemplateArgumentList *args =
@@ -400,11 +406,12 @@ static void emitFunctionPointer(llvm::raw_ostream &os,
   os << ")";
 }
 
-static void emitManualBindings(llvm::raw_ostream &os,
-                               const clang::ASTContext &context,
-                               const clang::LambdaExpr *manual_bindings) {
+static void printManualBindings(llvm::raw_ostream &os,
+                                const QualifiedTypeNames &type_names,
+                                const clang::LambdaExpr *manual_bindings) {
   assert(manual_bindings != nullptr);
-  auto printing_policy = getPrintingPolicyForExposedNames(context);
+  const clang::ASTContext &context = type_names.getASTContext();
+  const clang::PrintingPolicy &printing_policy = type_names.getPrintingPolicy();
   // Print and immediately invoke manual bindings lambda(IIFE).
   // TODO: This requires all referenced types and declarations in the manual
   // binding code to be fully qualified.  It would be useful to atleast warn if
@@ -425,18 +432,120 @@ static void emitManualBindings(llvm::raw_ostream &os,
     os << "(context);\n";
 }
 
-static std::vector<const clang::NamedDecl *>
-collectOperatorDeclsViaArgumentDependentLookup(
-    clang::Sema &sema, const clang::CXXRecordDecl *record) {
+namespace {
+
+/// Finds operators in a record's associated namespaces (and hidden friends in
+/// its associated classes), as `Sema::ArgumentDependentLookup` would.  Since
+/// many records share the same associated namespaces, the candidates are
+/// looked up only once per namespace and operator kind and then filtered for
+/// each record.
+class AssociatedOperatorIndex {
+  struct Candidate {
+    const clang::NamedDecl *decl;
+    /// Whether there is a declaration that is visible to ordinary lookup.
+    bool ordinary = false;
+    /// Classes with a friend declaration of the candidate.  A friend is only
+    /// found if one of these is an associated class.
+    llvm::SmallVector<const clang::CXXRecordDecl *, 1> befriending_classes;
+  };
+
+  clang::Sema &sema;
+  llvm::DenseMap<std::pair<const clang::DeclContext *,
+                           clang::OverloadedOperatorKind>,
+                 std::vector<Candidate>>
+      candidates;
+
+  const std::vector<Candidate> &
+  candidatesIn(const clang::DeclContext *ns,
+               clang::OverloadedOperatorKind op_kind);
+
+public:
+  explicit AssociatedOperatorIndex(clang::Sema &sema) : sema(sema) {}
+
+  std::vector<const clang::NamedDecl *>
+  collect(const clang::CXXRecordDecl *record);
+};
+
+} // namespace
+
+static constexpr clang::OverloadedOperatorKind associated_operator_kinds[] = {
+    clang::OO_Plus,
+    clang::OO_Minus,
+    clang::OO_Star,
+    clang::OO_Slash,
+    clang::OO_Percent,
+    clang::OO_Caret,
+    clang::OO_Amp,
+    clang::OO_Pipe,
+    clang::OO_Tilde,
+    clang::OO_Less,
+    clang::OO_Greater,
+    clang::OO_PlusEqual,
+    clang::OO_MinusEqual,
+    clang::OO_StarEqual,
+    clang::OO_SlashEqual,
+    clang::OO_PercentEqual,
+    clang::OO_CaretEqual,
+    clang::OO_AmpEqual,
+    clang::OO_PipeEqual,
+    clang::OO_LessLess,
+    clang::OO_GreaterGreater,
+    clang::OO_LessLessEqual,
+    clang::OO_GreaterGreaterEqual,
+    clang::OO_EqualEqual,
+    clang::OO_ExclaimEqual,
+    clang::OO_LessEqual,
+    clang::OO_GreaterEqual,
+    clang::OO_Spaceship,
+};
+
+const std::vector<AssociatedOperatorIndex::Candidate> &
+AssociatedOperatorIndex::candidatesIn(const clang::DeclContext *ns,
+                                      clang::OverloadedOperatorKind op_kind) {
+  auto [it, inserted] = candidates.try_emplace({ns, op_kind});
+  if (!inserted)
+    return it->second;
+
+  // This mirrors the visibility rules in `Sema::ArgumentDependentLookup`
+  // (ignoring modules, which are not supported in any case).
+  const clang::DeclarationName op_name =
+      sema.getASTContext().DeclarationNames.getCXXOperatorName(op_kind);
+  for (const clang::NamedDecl *decl : ns->lookup(op_name)) {
+    const clang::NamedDecl *underlying = decl;
+    if (const auto *shadow = llvm::dyn_cast<clang::UsingShadowDecl>(decl))
+      underlying = shadow->getTargetDecl();
+    if (!llvm::isa<clang::FunctionDecl, clang::FunctionTemplateDecl>(
+            underlying))
+      continue;
+
+    Candidate candidate{underlying};
+    for (const clang::NamedDecl *redecl = decl->getMostRecentDecl();
+         redecl != nullptr;
+         redecl = llvm::cast_or_null<clang::NamedDecl>(
+             redecl->getPreviousDecl())) {
+      if (redecl->getIdentifierNamespace() & clang::Decl::IDNS_Ordinary) {
+        candidate.ordinary = true;
+        break;
+      }
+      if (redecl->getFriendObjectKind() != clang::Decl::FOK_None)
+        candidate.befriending_classes.push_back(
+            llvm::cast<clang::CXXRecordDecl>(redecl->getLexicalDeclContext()));
+    }
+    it->second.push_back(std::move(candidate));
+  }
+  return it->second;
+}
+
+std::vector<const clang::NamedDecl *>
+AssociatedOperatorIndex::collect(const clang::CXXRecordDecl *record) {
   std::vector<const clang::NamedDecl *> result;
   const clang::ASTContext &ast_context = sema.getASTContext();
   clang::SourceLocation op_loc;
 
-  // Use argument dependent lookup to find operators in a record's associated
-  // namespace.  To this end, a fake argument list with an emulated
-  // declval<T>() expression is used.  Inside `ArgumentDependentLookup` the
-  // arguments are only used for this purpose and are not checked against the
-  // function signatures, so a single entry is sufficient.
+  // Determine the associated namespaces and classes of the record.  To this
+  // end, a fake argument list with an emulated declval<T>() expression is
+  // used.  The arguments are only used for this purpose and are not checked
+  // against the function signatures, so a single entry is sufficient.
   const clang::QualType record_type = ast_context.getTypeDeclType(record);
   assert(record_type->isObjectType());
   clang::QualType expr_type = ast_context.getRValueReferenceType(record_type)
@@ -444,6 +553,44 @@ collectOperatorDeclsViaArgumentDependentLookup(
   clang::OpaqueValueExpr declval_expr(
       op_loc, expr_type, clang::Expr::getValueKindForType(expr_type));
   clang::Expr *args_for_adl[1] = {&declval_expr};
+  clang::Sema::AssociatedNamespaceSet associated_namespaces;
+  clang::Sema::AssociatedClassSet associated_classes;
+  sema.FindAssociatedClassesAndNamespaces(op_loc, args_for_adl,
+                                          associated_namespaces,
+                                          associated_classes);
+
+  // Collect candidates in the same order as repeated calls to
+  // `Sema::ArgumentDependentLookup` would, keeping the most recent
+  // declaration of each entity.
+  llvm::MapVector<const clang::Decl *, const clang::NamedDecl *> found;
+  auto is_more_recent = [](const clang::Decl *decl,
+                           const clang::Decl *other) {
+    for (const clang::Decl *prev = decl->getPreviousDecl(); prev != nullptr;
+         prev = prev->getPreviousDecl())
+      if (prev == other)
+        return true;
+    return false;
+  };
+  for (clang::OverloadedOperatorKind op_kind : associated_operator_kinds) {
+    // Rewritten candidates are not considered here; they are taken into
+    // account when deciding what operators to emit in `RecordExposer`.
+    for (const clang::DeclContext *ns : associated_namespaces) {
+      for (const Candidate &candidate : candidatesIn(ns, op_kind)) {
+        if (!candidate.ordinary &&
+            !llvm::any_of(candidate.befriending_classes,
+                          [&](const clang::CXXRecordDecl *befriending) {
+                            return associated_classes.count(
+                                const_cast<clang::CXXRecordDecl *>(
+                                    befriending));
+                          }))
+          continue;
+        const clang::NamedDecl *&existing =
+            found[candidate.decl->getCanonicalDecl()];
+        if (existing == nullptr || is_more_recent(candidate.decl, existing))
+          existing = candidate.decl;
+      }
+    }
+  }
 
   // At least one parameter has to accept the record type, without
   // implicit conversions.
@@ -451,51 +598,14 @@ collectOperatorDeclsViaArgumentDependentLookup(
     clang::QualType param_type = param->getType().getNonReferenceType();
     return ast_context.hasSameUnqualifiedType(param_type, record_type);
   };
-  auto handle_decl = [&](clang::NamedDecl *decl) {
+  auto handle_decl = [&](const clang::NamedDecl *decl) {
     const auto *function = llvm::cast<clang::FunctionDecl>(decl);
     if (llvm::any_of(function->parameters(), has_type_of_record))
       result.push_back(decl);
   };
 
-  clang::ADLResult operator_decls;
-  for (clang::OverloadedOperatorKind op_kind : {
-           clang::OO_Plus,
-           clang::OO_Minus,
-           clang::OO_Star,
-           clang::OO_Slash,
-           clang::OO_Percent,
-           clang::OO_Caret,
-           clang::OO_Amp,
-           clang::OO_Pipe,
-           clang::OO_Tilde,
-           clang::OO_Less,
-           clang::OO_Greater,
-           clang::OO_PlusEqual,
-           clang::OO_MinusEqual,
-           clang::OO_StarEqual,
-           clang::OO_SlashEqual,
-           clang::OO_PercentEqual,
-           clang::OO_CaretEqual,
-           clang::OO_AmpEqual,
-           clang::OO_PipeEqual,
-           clang::OO_LessLess,
-           clang::OO_GreaterGreater,
-           clang::OO_LessLessEqual,
-           clang::OO_GreaterGreaterEqual,
-           clang::OO_EqualEqual,
-           clang::OO_ExclaimEqual,
-           clang::OO_LessEqual,
-           clang::OO_GreaterEqual,
-           clang::OO_Spaceship,
-       }) {
-    // Rewritten candidates are not considered here; they are taken into
-    // account when deciding what operators to emit in `RecordExposer`.
-    clang::DeclarationName op_name =
-        ast_context.DeclarationNames.getCXXOperatorName(op_kind);
-    sema.ArgumentDependentLookup(op_name, op_loc, args_for_adl, operator_decls);
-  }
-
-  for (clang::NamedDecl *decl : operator_decls) {
+  for (const auto &entry : found) {
+    const clang::NamedDecl *decl = entry.second;
     if (const auto *tpl = llvm::dyn_cast<clang::FunctionTemplateDecl>(decl)) {
       llvm::for_each(tpl->specializations(), handle_decl);
     } else {
@@ -642,27 +752,192 @@ std::string genpybind::getFullyQualifiedName(const clang::TypeDecl *decl) {
                                                 /*WithGlobalNsPrefix=*/true);
 }
 
+/// Return the declarations to expose in the given context, in the order in
+/// which they should be emitted.
+static std::vector<const clang::NamedDecl *> collectExposedDecls(
+    clang::Sema &sema, VisibleDeclsCache &visible_decls,
+    AssociatedOperatorIndex &associated_operators,
+    const clang::DeclContext *decl_context,
+    const std::optional<RecordInliningPolicy> &inlining_policy) {
+  std::vector<const clang::NamedDecl *> decls = [&] {
+    llvm::TimeTraceScope scope("CollectVisibleDecls");
+    return visible_decls.get(decl_context, inlining_policy);
+  }();
+  llvm::sort(decls, IsBeforeInTranslationUnit(sema.getSourceManager()));
+
+  const auto *record = llvm::dyn_cast<clang::CXXRecordDecl>(decl_context);
+
+  // Inject operators from a record's associated namespace (found via ADL),
+  // as these need to be exposed as methods of the record.  Only user-defined
+  // operators that can be called without conversions are considered.
+  if (record != nullptr) {
+    llvm::TimeTraceScope scope("ArgumentDependentLookup");
+    std::vector<const clang::NamedDecl *> associated_decls =
+        associated_operators.collect(record);
+    llvm::copy(associated_decls, std::back_inserter(decls));
+  }
+
+  std::vector<const clang::NamedDecl *> result;
+  result.reserve(decls.size());
+  for (const clang::NamedDecl *proposed_decl : decls) {
+    // If there are several declarations of a function template,
+    // only one is picked up here.  Thus all specializations can be
+    // processed unconditionally.
+    if (const auto *tpl =
+            llvm::dyn_cast<clang::FunctionTemplateDecl>(proposed_decl)) {
+      bool has_explicit_object_parameter =
+          tpl->getTemplatedDecl()->hasCXXExplicitFunctionObjectParameter();
+      for (const clang::FunctionDecl *fun : tpl->specializations()) {
+        // Derived classes may pull in (via using decls or `inline_base`)
+        // template instantiations with explicit object parameters of
+        // unrelated types from base classes.  Skip those, even though it's
+        // not strictly necessary (as they're not viable candidates during
+        // overload resolution at run time).
+        if (has_explicit_object_parameter && record != nullptr) {
+          if (const auto *param = fun->getParamDecl(0)
+                                      ->getType()
+                                      .getNonReferenceType()
+                                      .getUnqualifiedType()
+                                      ->getAsCXXRecordDecl();
+              param != nullptr &&
+              param->getCanonicalDecl() != record->getCanonicalDecl() &&
+              !param->isDerivedFrom(record)) {
+            continue;
+          }
+        }
+        result.push_back(fun);
+      }
+    } else {
+      result.push_back(proposed_decl);
+    }
+  }
+  return result;
+}
+
+/// Serializes the computation of values that are missing from a frozen
+/// cache.  This is shared by all caches, as all of them modify the
+/// `ASTContext` on a miss.
+static std::recursive_mutex fallback_mutex;
+
+/// Return the value for `key` from `cache`, computing and storing it first if
+/// necessary.  Frozen caches are read concurrently and thus never modified.
+/// All values should have been computed before freezing the cache; otherwise
+/// the value is computed again on each lookup.
+template <typename Key, typename Compute>
+static llvm::StringRef
+lookupOrCompute(llvm::DenseMap<Key, llvm::StringRef> &cache,
+                llvm::StringSaver &saver, bool frozen,
+                std::type_identity_t<Key> key, Compute &&compute) {
+  if (auto it = cache.find(key); it != cache.end())
+    return it->second;
+  assert(!frozen && "value should have been computed before rendering");
+  if (frozen) {
+    std::lock_guard<std::recursive_mutex> lock(fallback_mutex);
+    return saver.save(compute());
+  }
+  // Computing the value might add other entries to the cache.
+  llvm::StringRef value = saver.save(compute());
+  cache.try_emplace(key, value);
+  return value;
+}
+
+QualifiedTypeNames::QualifiedTypeNames(const clang::ASTContext &context)
+    : context(context),
+      printing_policy(getPrintingPolicyForExposedNames(context)) {}
+
+llvm::StringRef QualifiedTypeNames::get(clang::QualType qual_type) {
+  return lookupOrCompute(names, saver, frozen, qual_type, [&] {
+    return clang::TypeName::getFullyQualifiedName(
+        qual_type, context, printing_policy, /*WithGlobalNsPrefix=*/true);
+  });
+}
+
+llvm::StringRef QualifiedTypeNames::get(const clang::TypeDecl *decl) {
+  return get(context.getTypeDeclType(decl));
+}
+
+llvm::StringRef DeclTexts::getBriefText(const clang::Decl *decl) {
+  return lookupOrCompute(brief_texts, saver, frozen, decl, [&] {
+    const clang::ASTContext &context = decl->getASTContext();
+    if (const clang::RawComment *raw = context.getRawCommentForAnyRedecl(decl))
+      return raw->getBriefText(context).str();
+    return std::string();
+  });
+}
+
+llvm::StringRef DeclTexts::getDocstring(const clang::FunctionDecl *function) {
+  llvm::StringRef result = getBriefText(function);
+  if (result.empty())
+    if (const clang::FunctionTemplateDecl *primary =
+            function->getPrimaryTemplate())
+      result = getBriefText(primary);
+  return result;
+}
+
+/// Print `expr` with fully qualified types, see
+/// `AttemptFullQualificationPrinter`.
+static std::string printInitializer(QualifiedTypeNames &type_names,
+                                    const clang::Expr *expr) {
+  std::string result;
+  if (expr == nullptr)
+    return result;
+  llvm::raw_string_ostream os(result);
+  AttemptFullQualificationPrinter printer_helper{type_names};
+  expr->printPretty(os, &printer_helper, type_names.getPrintingPolicy(),
+                    /*Indentation=*/0, /*NewlineSymbol=*/"\n",
+                    &type_names.getASTContext());
+  return result;
+}
+
+llvm::StringRef DeclTexts::getInitializer(const clang::ParmVarDecl *param) {
+  return lookupOrCompute(initializers, saver, frozen, param, [&] {
+    if (param->hasUnparsedDefaultArg() || param->hasUninstantiatedDefaultArg())
+      return std::string();
+    return printInitializer(type_names, param->getDefaultArg());
+  });
+}
+
+llvm::StringRef DeclTexts::getInitializer(const clang::FieldDecl *field) {
+  return lookupOrCompute(initializers, saver, frozen, field, [&] {
+    return printInitializer(type_names, field->getInClassInitializer());
+  });
+}
+
+llvm::StringRef DeclTexts::getManualBindings(const clang::LambdaExpr *lambda) {
+  return lookupOrCompute(manual_bindings, saver, frozen, lambda, [&] {
+    std::string result;
+    llvm::raw_string_ostream os(result);
+    printManualBindings(os, type_names, lambda);
+    return result;
+  });
+}
+
 TranslationUnitExposer::TranslationUnitExposer(
     clang::Sema &sema, const DeclContextGraph &graph,
-    const EffectiveVisibilityMap &visibilities, AnnotationStorage &annotations)
+    const EffectiveVisibilityMap &visibilities, AnnotationStorage &annotations,
+    VisibleDeclsCache &visible_decls)
     : sema(sema), graph(graph), visibilities(visibilities),
-      annotations(annotations) {}
-
-void TranslationUnitExposer::emitModule(
-    std::vector<llvm::raw_ostream *> ostreams, llvm::StringRef module_name) {
-  assert(!ostreams.empty());
+      annotations(annotations), visible_decls(visible_decls),
+      type_names(sema.getASTContext()) {}
 
+std::optional<ModuleBindings>
+TranslationUnitExposer::exposeModule(llvm::StringRef module_name,
+                                     const ShardingOptions &sharding,
+                                     unsigned num_threads) {
   const EnclosingScopeMap parents = findEnclosingScopes(graph, annotations);
 
   const clang::DeclContext *cycle = nullptr;
-  const auto sorted_contexts = declContextsSortedByDependencies(
-      graph, parents, sema.getSourceManager(), &cycle);
+  const auto sorted_contexts = [&] {
+    llvm::TimeTraceScope scope("SortDeclContexts");
+    return declContextsSortedByDependencies(graph, parents,
+                                            sema.getSourceManager(), &cycle);
+  }();
   if (cycle != nullptr) {
     // TODO: Report this before any other output, ideally pointing to the
     // typedef name decl for `expose_here` cycles.
     Diagnostics::report(llvm::cast<clang::Decl>(cycle),
                         Diagnostics::Kind::ExposeHereCycleError);
-    return;
+    return std::nullopt;
   }
 
   llvm::DenseMap<const clang::DeclContext *, std::string> context_identifiers(
@@ -707,7 +982,7 @@ void TranslationUnitExposer::emitModule(
       llvm::SmallString<128> name("context");
       if (auto const *type_decl =
               llvm::dyn_cast<clang::TypeDecl>(decl_context)) {
-        name += getFullyQualifiedName(type_decl);
+        name += type_names.get(type_decl);
       } else if (auto const *ns_decl =
                      llvm::dyn_cast<clang::NamedDecl>(decl_context)) {
         name.push_back('_');
@@ -720,181 +995,253 @@ void TranslationUnitExposer::emitModule(
       llvm::StringRef identifier = result.first->getSecond();
       worklist.push_back(
           {decl_context,
-           DeclContextExposer::create(graph, annotations, decl_context),
+           DeclContextExposer::create(graph, annotations, type_names, texts,
+                                      decl_context),
            identifier});
     }
   }
 
-  auto emit_expose_declarator = [](llvm::raw_ostream &os,
-                                   const WorklistItem &item) {
-    os << "void expose_" << item.identifier << "(";
-    item.exposer->emitParameter(os);
-    os << ")";
+  // With several partitions, each context is only rendered by one of them.
+  // As the other partitions do not know the cost of the generated code, the
+  // contexts are balanced based on their number of declarations instead.
+  // The requested shard assignment also applies to partitions, s.t. with
+  // `ShardAssignment::Hash` contexts stay in the same partition when others
+  // are added or removed.
+  std::vector<bool> is_rendered(worklist.size(), true);
+  if (sharding.num_partitions > 1) {
+    assert(sharding.max_context_cost == 0 &&
+           "parts of a context are only known after rendering");
+    std::vector<std::uint64_t> estimates;
+    estimates.reserve(worklist.size());
+    for (const WorklistItem &item : worklist) {
+      estimates.push_back(
+          1 + static_cast<std::uint64_t>(std::distance(
+                  item.decl_context->decls_begin(),
+                  item.decl_context->decls_end())));
+    }
+    const std::vector<unsigned> partitions = [&] {
+      switch (sharding.assignment) {
+      case ShardAssignment::Cost:
+        return balanceShards(estimates, sharding.num_partitions,
+                             /*first_shard_cost=*/worklist.size());
+      case ShardAssignment::Hash: {
+        std::vector<llvm::StringRef> keys;
+        keys.reserve(worklist.size());
+        for (const WorklistItem &item : worklist)
+          keys.push_back(item.identifier);
+        return hashShards(keys, estimates, sharding.num_partitions,
+                          /*first_shard_cost=*/worklist.size());
+      }
+      }
+      llvm_unreachable("Unknown shard assignment.");
+    }();
+    for (auto index : llvm::seq<std::size_t>(0, worklist.size()))
+      is_rendered[index] = partitions[index] == sharding.partition;
+  }
+
+  // Render the bindings for each context.  This happens in two stages: First,
+  // all declarations to expose are collected, which involves name lookup and
+  // template instantiation and thus `Sema`.  All type names and texts used in
+  // the output are computed at this point, too, since printing them modifies
+  // the `ASTContext` and deserializes declarations from a precompiled header.
+  // Afterwards, the contexts only read from the AST and are rendered
+  // concurrently, each declaration into its own buffer.  Their placement in
+  // the output is left to `emitBindings`.  Diagnostics and statistics are
+  // reported in the order of the worklist, s.t. neither depends on the
+  // number of threads.
+  struct ExposedDecls {
+    /// For inlined decls use the default visibility of the current
+    /// lookup context.
+    bool default_visibility = false;
+    std::vector<const clang::NamedDecl *> decls;
   };
 
-  llvm::raw_ostream &main_stream = *ostreams.front();
+  std::vector<ExposedDecls> exposed_decls(worklist.size());
+  {
+    AssociatedOperatorIndex associated_operators(sema);
+    InstantiatedSpecializations instantiated(sema);
+    for (auto index : llvm::seq<std::size_t>(0, worklist.size())) {
+      if (!is_rendered[index])
+        continue;
+      const WorklistItem &item = worklist[index];
+      llvm::TimeTraceScope scope("CollectExposedDecls", item.identifier);
+      ExposedDecls &exposed = exposed_decls[index];
+      exposed.default_visibility = [&] {
+        auto it = visibilities.find(item.decl_context);
+        return it != visibilities.end() ? it->getSecond() : false;
+      }();
+      exposed.decls = collectExposedDecls(
+          sema, visible_decls, associated_operators, item.decl_context,
+          item.exposer->inliningPolicy());
+      // Default arguments are only instantiated for the functions in the
+      // remaining contexts, since they are needed by `emitParameters`.
+      for (const clang::NamedDecl *decl : exposed.decls) {
+        if (const auto *function = llvm::dyn_cast<clang::FunctionDecl>(decl))
+          instantiateDefaultArguments(sema, function);
+      }
+      if (ModuleStatistics *statistics = currentStatistics())
+        statistics->visited_decls += exposed.decls.size();
+    }
+    // The graph has already been built, so annotated specializations that have
+    // only been instantiated by default arguments are missing from it.
+    for (const clang::ClassTemplateSpecializationDecl *specialization :
+         instantiated.get()) {
+      if (graph.getNode(specialization) != nullptr ||
+          !hasAnnotations(specialization))
+        continue;
+      annotations.insert(specialization);
+      if (!annotations.lookup<NamedDeclAttrs>(specialization)
+               .visible.value_or(true))
+        continue;
+      Diagnostics::report(
+          specialization,
+          Diagnostics::Kind::SpecializationInstantiatedByDefaultArgumentWarning)
+          << getNameForDisplay(specialization);
+    }
+  }
 
-  // Emit declarations for `expose_` functions
-  for (const auto &item : worklist) {
-    emit_expose_declarator(main_stream, item);
-    main_stream << ";\n";
+  {
+    llvm::TimeTraceScope scope("PrepareRendering");
+    for (auto index : llvm::seq<std::size_t>(0, worklist.size())) {
+      DeclContextExposer &exposer = *worklist[index].exposer;
+      exposer.prepareContext();
+      for (const clang::NamedDecl *decl : exposed_decls[index].decls) {
+        annotations.insert(decl);
+        exposer.prepareDecl(decl);
+      }
+    }
   }
 
-  main_stream << '\n';
+  // Render code using the given exposer, together with the constructs that
+  // were emitted.
+  auto render = [](DeclContextExposer &exposer, auto &&emit) {
+    RenderedCode rendered;
+    {
+      llvm::raw_string_ostream os(rendered.code);
+      emit(os);
+    }
+    rendered.metrics = exposer.takeMetrics();
+    rendered.metrics.bytes = rendered.code.size();
+    return rendered;
+  };
 
-  // Emit module definition
-  main_stream << "PYBIND11_MODULE(" << module_name << ", root) {\n";
+  ModuleBindings module;
+  module.module_name = module_name.str();
+  module.contexts.resize(worklist.size());
+  auto render_context = [&](std::size_t index) {
+    const WorklistItem &item = worklist[index];
+    DeclContextExposer &exposer = *item.exposer;
+    ContextBindings &context = module.contexts[index];
+    context.identifier = item.identifier.str();
+    {
+      llvm::raw_string_ostream os(context.parameter);
+      exposer.emitParameter(os);
+    }
+    {
+      const clang::DeclContext *parent = parents.lookup(item.decl_context);
+      assert((parent != nullptr) ^
+                 llvm::isa<clang::TranslationUnitDecl>(item.decl_context) &&
+             "(only) non-TU contexts should have a parent scope");
+      auto parent_identifier = context_identifiers.find(parent);
+      assert(parent_identifier != context_identifiers.end() &&
+             "identifier should have been stored at this point");
+      context.introducer = render(exposer, [&](llvm::raw_ostream &os) {
+        exposer.emitIntroducer(os, parent_identifier->getSecond());
+      });
+    }
 
-  // Emit context introducers
-  for (const auto &item : worklist) {
-    const clang::DeclContext *parent = parents.lookup(item.decl_context);
-    assert((parent != nullptr) ^
-               llvm::isa<clang::TranslationUnitDecl>(item.decl_context) &&
-           "(only) non-TU contexts should have a parent scope");
-    auto parent_identifier = context_identifiers.find(parent);
-    assert(parent_identifier != context_identifiers.end() &&
-           "identifier should have been stored at this point");
+    context.is_rendered = is_rendered[index];
+    if (!context.is_rendered)
+      return;
 
-    main_stream << "auto " << item.identifier << " = ";
-    item.exposer->emitIntroducer(main_stream, parent_identifier->getSecond());
-    main_stream << ";\n";
-  }
+    llvm::TimeTraceScope scope("ExposeDeclContext", item.identifier);
+    const ExposedDecls &exposed = exposed_decls[index];
+    for (const clang::NamedDecl *decl : exposed.decls) {
+      RenderedCode declaration = render(exposer, [&](llvm::raw_ostream &os) {
+        exposer.handleDecl(os, decl, exposed.default_visibility);
+      });
+      if (!declaration.code.empty())
+        context.declarations.push_back(std::move(declaration));
+    }
 
-  main_stream << '\n';
+    context.finalization = render(exposer, [&](llvm::raw_ostream &os) {
+      exposer.finalizeDefinition(os);
+    });
+  };
 
-  // Emit calls to `expose_` functions
-  for (const auto &item : worklist) {
-    main_stream << "expose_" << item.identifier << "(" << item.identifier
-                << ");\n";
+  type_names.setFrozen(true);
+  texts.setFrozen(true);
+  if (num_threads <= 1 || worklist.size() <= 1) {
+    for (auto index : llvm::seq<std::size_t>(0, worklist.size()))
+      render_context(index);
+  } else {
+    llvm::ThreadPool pool(llvm::hardware_concurrency(num_threads));
+    for (auto index : llvm::seq<std::size_t>(0, worklist.size()))
+      pool.async([&render_context, index] { render_context(index); });
+    pool.wait();
+  }
+  type_names.setFrozen(false);
+  texts.setFrozen(false);
+
+  ModuleStatistics *statistics = currentStatistics();
+  for (const WorklistItem &item : worklist) {
+    item.exposer->reportDiagnostics();
+    if (statistics != nullptr)
+      item.exposer->addStatistics(*statistics);
   }
 
-  { // Emit 'postamble' manual bindings.
+  { // Render 'postamble' manual bindings.
+    llvm::raw_string_ostream os(module.postamble);
     const clang::DeclContext *decl_context = graph.getRoot()->getDeclContext();
     for (clang::DeclContext::specific_decl_iterator<clang::VarDecl>
              it(decl_context->decls_begin()),
          end_it(decl_context->decls_end());
          it != end_it; ++it) {
-      const auto attrs = annotations.lookup<FieldOrVarDeclAttrs>(*it);
+      const auto &attrs = annotations.lookup<FieldOrVarDeclAttrs>(*it);
       if (!attrs.postamble || attrs.manual_bindings == nullptr)
         continue;
-      const clang::ASTContext &ast_context = it->getASTContext();
-      main_stream << "\n";
-      emitManualBindings(main_stream, ast_context, attrs.manual_bindings);
+      os << "\n";
+      os << texts.getManualBindings(attrs.manual_bindings);
     }
   }
 
-  main_stream << "}\n\n";
-
-  // Emit definitions for `expose_` functions
-  unsigned index = 0;
-  for (const auto &item : worklist) {
-    // Distribute chunks of consecutive exposers to the different streams.
-    llvm::raw_ostream &os =
-        *ostreams[index++ * ostreams.size() / worklist.size()];
-    // Also emit declaration to this stream, in order to avoid
-    // `-Wmissing-declarations` warnings.
-    if (&os != &main_stream) {
-      emit_expose_declarator(os, item);
-      os << ";\n";
-    }
-    emit_expose_declarator(os, item);
-    os << " {\n";
-
-    // For inlined decls use the default visibility of the current
-    // lookup context.
-    bool default_visibility = [&] {
-      auto it = visibilities.find(item.decl_context);
-      return it != visibilities.end() ? it->getSecond() : false;
-    }();
-
-    auto handle_decl = [&](const clang::NamedDecl *proposed_decl) {
-      annotations.insert(proposed_decl);
-      item.exposer->handleDecl(os, proposed_decl, default_visibility);
-    };
-
-    std::vector<const clang::NamedDecl *> decls =
-        collectVisibleDeclsFromDeclContext(sema, item.decl_context,
-                                           item.exposer->inliningPolicy());
-    llvm::sort(decls, IsBeforeInTranslationUnit(sema.getSourceManager()));
-
-    const auto *record =
-        llvm::dyn_cast<clang::CXXRecordDecl>(item.decl_context);
-
-    // Inject operators from a record's associated namespace (found via ADL),
-    // as these need to be exposed as methods of the record.  Only user-defined
-    // operators that can be called without conversions are considered.
-    if (record != nullptr) {
-      std::vector<const clang::NamedDecl *> associated_decls =
-          collectOperatorDeclsViaArgumentDependentLookup(sema, record);
-      llvm::copy(associated_decls, std::back_inserter(decls));
-    }
-
-    for (const clang::NamedDecl *proposed_decl : decls) {
-      // If there are several declarations of a function template,
-      // only one is picked up here.  Thus all specializations can be
-      // processed unconditionally.
-      if (const auto *tpl =
-              llvm::dyn_cast<clang::FunctionTemplateDecl>(proposed_decl)) {
-        bool has_explicit_object_parameter =
-            tpl->getTemplatedDecl()->hasCXXExplicitFunctionObjectParameter();
-        for (const clang::FunctionDecl *fun : tpl->specializations()) {
-          // Derived classes may pull in (via using decls or `inline_base`)
-          // template instantiations with explicit object parameters of
-          // unrelated types from base classes.  Skip those, even though it's
-          // not strictly necessary (as they're not viable candidates during
-          // overload resolution at run time).
-          if (has_explicit_object_parameter && record != nullptr) {
-            if (const auto *param = fun->getParamDecl(0)
-                                        ->getType()
-                                        .getNonReferenceType()
-                                        .getUnqualifiedType()
-                                        ->getAsCXXRecordDecl();
-                param != nullptr &&
-                param->getCanonicalDecl() != record->getCanonicalDecl() &&
-                !param->isDerivedFrom(record)) {
-              continue;
-            }
-          }
-          handle_decl(fun);
-        }
-      } else {
-        handle_decl(proposed_decl);
-      }
-    }
-
-    item.exposer->finalizeDefinition(os);
-    os << "}\n\n";
-  }
+  return module;
 }
 
-DeclContextExposer::DeclContextExposer(const AnnotationStorage &annotations)
-    : annotations(annotations) {}
+DeclContextExposer::DeclContextExposer(const AnnotationStorage &annotations,
+                                       QualifiedTypeNames &type_names,
+                                       DeclTexts &texts)
+    : annotations(annotations), type_names(type_names), texts(texts) {}
 
 std::unique_ptr<DeclContextExposer>
 DeclContextExposer::create(const DeclContextGraph &graph,
                            const AnnotationStorage &annotations,
+                           QualifiedTypeNames &type_names, DeclTexts &texts,
                            const clang::DeclContext *decl_context) {
   assert(decl_context != nullptr);
   if (const auto *named_decl = llvm::dyn_cast<clang::NamedDecl>(decl_context)) {
     if (NamespaceDeclAttrs::supports(named_decl)) {
       const auto *namespace_decl = llvm::cast<clang::NamespaceDecl>(named_decl);
-      return std::make_unique<NamespaceExposer>(namespace_decl, annotations);
+      return std::make_unique<NamespaceExposer>(namespace_decl, annotations,
+                                                type_names, texts);
     }
     if (EnumDeclAttrs::supports(named_decl)) {
       const auto *enum_decl = llvm::cast<clang::EnumDecl>(named_decl);
-      return std::make_unique<EnumExposer>(enum_decl, annotations);
+      return std::make_unique<EnumExposer>(enum_decl, annotations,
+                                           type_names, texts);
     }
     if (RecordDeclAttrs::supports(named_decl)) {
       const auto *record_decl = llvm::cast<clang::CXXRecordDecl>(named_decl);
       return std::make_unique<RecordExposer>(
-          record_decl, graph, annotations,
+          record_decl, graph, annotations, type_names, texts,
           RecordInliningPolicy::createFromAnnotations(annotations,
                                                       record_decl));
     }
   }
   const auto *decl = llvm::cast<clang::Decl>(decl_context);
   if (DeclContextGraph::accepts(decl))
-    return std::make_unique<DeclContextExposer>(annotations);
+    return std::make_unique<DeclContextExposer>(annotations, type_names,
+                                                texts);
 
   llvm_unreachable("Unknown declaration context kind.");
 }
@@ -903,6 +1250,36 @@ std::optional<RecordInliningPolicy> DeclContextExposer::inliningPolicy() const {
   return std::nullopt;
 }
 
+/// Compute everything `handleDeclImpl` and `emitParameters` need to expose
+/// `function`.
+static void prepareFunction(QualifiedTypeNames &type_names, DeclTexts &texts,
+                            const clang::FunctionDecl *function) {
+  type_names.get(function->getReturnType());
+  for (const clang::ParmVarDecl *param : function->parameters()) {
+    type_names.get(param->getOriginalType());
+    type_names.get(param->getType());
+    texts.getInitializer(param);
+  }
+  if (const auto *method = llvm::dyn_cast<clang::CXXMethodDecl>(function))
+    type_names.get(method->getParent());
+  texts.getDocstring(function);
+}
+
+void DeclContextExposer::prepareContext() {}
+
+void DeclContextExposer::prepareDecl(const clang::NamedDecl *decl) {
+  if (const auto *function = llvm::dyn_cast<clang::FunctionDecl>(decl))
+    prepareFunction(type_names, texts, function);
+  if (const auto *alias = llvm::dyn_cast<clang::TypedefNameDecl>(decl)) {
+    if (const clang::TagDecl *target =
+            alias->getUnderlyingType()->getAsTagDecl())
+      type_names.get(target);
+  }
+  if (const auto var_attrs = annotations.get<FieldOrVarDeclAttrs>(decl);
+      var_attrs != nullptr && var_attrs->manual_bindings != nullptr)
+    texts.getManualBindings(var_attrs->manual_bindings);
+}
+
 void DeclContextExposer::emitParameter(llvm::raw_ostream &os) {
   os << "::pybind11::module& context";
 }
@@ -917,7 +1294,7 @@ void DeclContextExposer::handleDecl(llvm::raw_ostream &os,
                                     bool default_visibility) {
   assert(decl != nullptr);
   if (const auto attrs = annotations.get<NamedDeclAttrs>(decl);
-      !attrs.has_value() || !attrs->visible.value_or(default_visibility)) {
+      attrs == nullptr || !attrs->visible.value_or(default_visibility)) {
     return;
   }
 
@@ -926,12 +1303,11 @@ void DeclContextExposer::handleDecl(llvm::raw_ostream &os,
 
 void DeclContextExposer::handleDeclImpl(llvm::raw_ostream &os,
                                         const clang::NamedDecl *decl) {
-  assert(!annotations.get<ConstructorDeclAttrs>(decl).has_value() &&
+  assert(annotations.get<ConstructorDeclAttrs>(decl) == nullptr &&
          "constructors are handled in RecordExposer");
-  const clang::ASTContext &ast_context = decl->getASTContext();
-  auto printing_policy = getPrintingPolicyForExposedNames(ast_context);
+  const clang::PrintingPolicy &printing_policy = type_names.getPrintingPolicy();
 
-  const auto named_attrs = annotations.lookup<NamedDeclAttrs>(decl);
+  const auto &named_attrs = annotations.lookup<NamedDeclAttrs>(decl);
   if (const auto typedef_attrs = annotations.get<TypedefNameDeclAttrs>(decl)) {
     // Type aliases are hidden by default and do not inherit the default
     // visibility, thus a second check is necessary here.
@@ -948,7 +1324,7 @@ void DeclContextExposer::handleDeclImpl(llvm::raw_ostream &os,
 
     os << "context.attr(";
     emitSpelling(os, decl, annotations.lookup<NamedDeclAttrs>(decl));
-    os << ") = ::genpybind::getObjectForType<" << getFullyQualifiedName(target)
+    os << ") = ::genpybind::getObjectForType<" << type_names.get(target)
        << ">();\n";
 
     return;
@@ -957,7 +1333,7 @@ void DeclContextExposer::handleDeclImpl(llvm::raw_ostream &os,
   if (const auto var_attrs = annotations.get<FieldOrVarDeclAttrs>(decl)) {
     if (var_attrs->manual_bindings != nullptr) {
       if (!var_attrs->postamble)
-        emitManualBindings(os, ast_context, var_attrs->manual_bindings);
+        os << texts.getManualBindings(var_attrs->manual_bindings);
       return;
     }
     // For fields and static member variables see `RecordExposer`.
@@ -985,33 +1361,57 @@ void DeclContextExposer::handleDeclImpl(llvm::raw_ostream &os,
       return;
 
     bool is_call_operator = function->getOverloadedOperator() == clang::OO_Call;
+    const std::string name =
+        getExposedName(decl, annotations.lookup<NamedDeclAttrs>(decl),
+                       is_call_operator ? "__call__" : "");
+    countFunction(name);
+    ++metrics.defs;
     os << ((method != nullptr && method->isStatic()) ? "context.def_static("
                                                      : "context.def(");
-    emitSpelling(os, decl, annotations.lookup<NamedDeclAttrs>(decl),
-                 is_call_operator ? "__call__" : "");
+    emitStringLiteral(os, name);
     os << ", ";
-    emitFunctionPointer(os, function);
+    emitFunctionPointer(os, type_names, metrics, function);
     os << ", ";
-    emitStringLiteral(os, getDocstring(function));
-    emitParameters(os, function, *fn_attrs);
+    emitStringLiteral(os, texts.getDocstring(function));
+    emitParameters(os, texts, diagnostics, function, *fn_attrs);
     emitPolicies(os, *fn_attrs);
     os << ");\n";
   }
 }
 
+void DeclContextExposer::countFunction(llvm::StringRef name) {
+  ++num_overloads;
+  function_names.insert(name);
+}
+
+void DeclContextExposer::reportDiagnostics() {
+  for (const auto &report : diagnostics)
+    report();
+  diagnostics.clear();
+}
+
+void DeclContextExposer::addStatistics(ModuleStatistics &statistics) const {
+  statistics.functions += function_names.size();
+  statistics.overloads += num_overloads;
+  statistics.operator_lambdas += num_operator_lambdas;
+}
+
 void DeclContextExposer::finalizeDefinition(llvm::raw_ostream &os) {
   os << "(void)context;\n";
 }
 
 NamespaceExposer::NamespaceExposer(const clang::NamespaceDecl *namespace_decl,
-                                   const AnnotationStorage &annotations)
-    : DeclContextExposer(annotations), namespace_decl(namespace_decl) {}
+                                   const AnnotationStorage &annotations,
+                                   QualifiedTypeNames &type_names,
+                                   DeclTexts &texts)
+    : DeclContextExposer(annotations, type_names, texts),
+      namespace_decl(namespace_decl) {}
 
 void NamespaceExposer::emitIntroducer(llvm::raw_ostream &os,
                                       llvm::StringRef parent_identifier) {
   os << parent_identifier;
   if (const auto attrs = annotations.get<NamespaceDeclAttrs>(namespace_decl);
-      attrs.has_value() && attrs->module) {
+      attrs != nullptr && attrs->module) {
     os << ".def_submodule(";
     emitSpelling(os, namespace_decl,
                  annotations.lookup<NamedDeclAttrs>(namespace_decl));
@@ -1020,8 +1420,20 @@ void NamespaceExposer::emitIntroducer(llvm::raw_ostream &os,
 }
 
 EnumExposer::EnumExposer(const clang::EnumDecl *enum_decl,
-                         const AnnotationStorage &annotations)
-    : DeclContextExposer(annotations), enum_decl(enum_decl) {}
+                         const AnnotationStorage &annotations,
+                         QualifiedTypeNames &type_names, DeclTexts &texts)
+    : DeclContextExposer(annotations, type_names, texts), enum_decl(enum_decl) {
+}
+
+void EnumExposer::prepareContext() {
+  type_names.get(enum_decl);
+  texts.getBriefText(enum_decl);
+}
+
+void EnumExposer::prepareDecl(const clang::NamedDecl *decl) {
+  if (llvm::isa<clang::EnumConstantDecl>(decl))
+    texts.getBriefText(decl);
+}
 
 void EnumExposer::emitParameter(llvm::raw_ostream &os) {
   emitType(os);
@@ -1030,15 +1442,16 @@ void EnumExposer::emitParameter(llvm::raw_ostream &os) {
 
 void EnumExposer::emitIntroducer(llvm::raw_ostream &os,
                                  llvm::StringRef parent_identifier) {
+  ++metrics.wrappers;
   emitType(os);
   os << "(" << parent_identifier << ", ";
   emitSpelling(os, enum_decl, annotations.lookup<NamedDeclAttrs>(enum_decl));
-  if (llvm::StringRef doc = getBriefText(enum_decl); !doc.empty()) {
+  if (llvm::StringRef doc = texts.getBriefText(enum_decl); !doc.empty()) {
     os << ", ";
     emitStringLiteral(os, doc);
   }
   if (const auto attrs = annotations.get<EnumDeclAttrs>(enum_decl);
-      attrs.has_value() && attrs->arithmetic) {
+      attrs != nullptr && attrs->arithmetic) {
     os << ", ::pybind11::arithmetic()";
   }
   os << ")";
@@ -1046,24 +1459,25 @@ void EnumExposer::emitIntroducer(llvm::raw_ostream &os,
 
 void EnumExposer::finalizeDefinition(llvm::raw_ostream &os) {
   if (const auto attrs = annotations.get<EnumDeclAttrs>(enum_decl);
-      attrs.has_value() &&
+      attrs != nullptr &&
       attrs->export_values.value_or(!enum_decl->isScoped())) {
     os << "context.export_values();\n";
   }
 }
 
 void EnumExposer::emitType(llvm::raw_ostream &os) {
-  os << "::pybind11::enum_<" << getFullyQualifiedName(enum_decl) << ">";
+  os << "::pybind11::enum_<" << type_names.get(enum_decl) << ">";
 }
 
 void EnumExposer::handleDeclImpl(llvm::raw_ostream &os,
                                  const clang::NamedDecl *decl) {
   if (const auto *enumerator = llvm::dyn_cast<clang::EnumConstantDecl>(decl)) {
-    const std::string scope = getFullyQualifiedName(enum_decl);
+    const llvm::StringRef scope = type_names.get(enum_decl);
+    ++metrics.values;
     os << "context.value(";
     emitSpelling(os, decl, annotations.lookup<NamedDeclAttrs>(decl));
     os << ", " << scope << "::" << enumerator->getName();
-    if (llvm::StringRef doc = getBriefText(decl); !doc.empty()) {
+    if (llvm::StringRef doc = texts.getBriefText(decl); !doc.empty()) {
       os << ", ";
       emitStringLiteral(os, doc);
     }
@@ -1074,14 +1488,73 @@ void EnumExposer::handleDeclImpl(llvm::raw_ostream &os,
 RecordExposer::RecordExposer(const clang::CXXRecordDecl *record_decl,
                              const DeclContextGraph &graph,
                              const AnnotationStorage &annotations,
+                             QualifiedTypeNames &type_names, DeclTexts &texts,
                              RecordInliningPolicy inlining_policy)
-    : DeclContextExposer(annotations), record_decl(record_decl), graph(graph),
+    : DeclContextExposer(annotations, type_names, texts),
+      record_decl(record_decl), graph(graph),
       inlining_policy(std::move(inlining_policy)) {}
 
 std::optional<RecordInliningPolicy> RecordExposer::inliningPolicy() const {
   return inlining_policy;
 }
 
+void RecordExposer::prepareContext() {
+  type_names.get(record_decl);
+  texts.getBriefText(record_decl);
+  // Load the members of records from a precompiled header, which are
+  // accessed by `finalizeDefinition`.
+  (void)record_decl->decls_empty();
+  auto prepare_bases = [&](const clang::CXXRecordDecl *decl,
+                           auto &&recurse) -> void {
+    for (const clang::CXXBaseSpecifier &base : decl->bases()) {
+      type_names.get(base.getType());
+      const clang::TagDecl *base_decl =
+          base.getType()->getAsTagDecl()->getDefinition();
+      if (base_decl == nullptr)
+        continue;
+      type_names.get(base_decl);
+      if (const auto *rd = llvm::dyn_cast<clang::CXXRecordDecl>(base_decl)) {
+        (void)rd->decls_empty();
+        recurse(rd, recurse);
+      }
+    }
+  };
+  prepare_bases(record_decl, prepare_bases);
+  if (!isEnabled(Experiment::Aggregates) || !record_decl->isAggregate())
+    return;
+  for (const clang::FieldDecl *field : record_decl->fields()) {
+    type_names.get(field->getType());
+    texts.getInitializer(field);
+  }
+}
+
+void RecordExposer::prepareDecl(const clang::NamedDecl *decl) {
+  DeclContextExposer::prepareDecl(decl);
+  if (!OperatorDeclAttrs::supports(decl))
+    return;
+  const auto *function = llvm::cast<clang::FunctionDecl>(decl);
+  const auto *method = llvm::dyn_cast<clang::CXXMethodDecl>(function);
+  const clang::ASTContext &ast_context = record_decl->getASTContext();
+
+  // Determine the parameters a corresponding free function definition would
+  // have.  In particular, prepend an explicit “self” parameter for
+  // member-functions (unless they already have an explicit object parameter).
+  llvm::SmallVector<clang::QualType, 2> parameter_types;
+  if (method != nullptr && !method->isExplicitObjectMemberFunction()) {
+    clang::QualType record_type = ast_context.getTypeDeclType(record_decl);
+    // TODO: Consider ref qualifiers.
+    if (method->isConst())
+      record_type = record_type.withConst();
+    parameter_types.push_back(ast_context.getLValueReferenceType(record_type));
+  }
+  for (const clang::ParmVarDecl *param : function->parameters()) {
+    parameter_types.push_back(param->getType());
+  }
+  for (clang::QualType type : parameter_types)
+    type_names.get(type);
+  operator_parameter_types[function] = std::move(parameter_types);
+}
+
 void RecordExposer::emitParameter(llvm::raw_ostream &os) {
   emitType(os);
   os << "& context";
@@ -1089,16 +1562,17 @@ void RecordExposer::emitParameter(llvm::raw_ostream &os) {
 
 void RecordExposer::emitIntroducer(llvm::raw_ostream &os,
                                    llvm::StringRef parent_identifier) {
+  ++metrics.wrappers;
   emitType(os);
   os << "(" << parent_identifier << ", ";
   emitSpelling(os, record_decl,
                annotations.lookup<NamedDeclAttrs>(record_decl));
-  if (llvm::StringRef doc = getBriefText(record_decl); !doc.empty()) {
+  if (llvm::StringRef doc = texts.getBriefText(record_decl); !doc.empty()) {
     os << ", ";
     emitStringLiteral(os, doc);
   }
   if (const auto attrs = annotations.get<RecordDeclAttrs>(record_decl);
-      attrs.has_value() && attrs->dynamic_attr) {
+      attrs != nullptr && attrs->dynamic_attr) {
     os << ", ::pybind11::dynamic_attr()";
   }
   os << ")";
@@ -1135,20 +1609,23 @@ void RecordExposer::emitProperties(llvm::raw_ostream &os) {
     if (property.getter == nullptr) {
       if (property.setter == nullptr)
         continue;
-      Diagnostics::report(property.setter,
-                          Diagnostics::Kind::PropertyHasNoGetterError)
-          << name;
+      diagnostics.push_back([setter = property.setter, name] {
+        Diagnostics::report(setter,
+                            Diagnostics::Kind::PropertyHasNoGetterError)
+            << name;
+      });
       continue;
     }
     bool writable = property.setter != nullptr;
+    ++metrics.defs;
     os << (writable ? "context.def_property("
                     : "context.def_property_readonly(");
     emitStringLiteral(os, name);
     os << ", ";
-    emitFunctionPointer(os, property.getter);
+    emitFunctionPointer(os, type_names, metrics, property.getter);
     if (writable) {
       os << ", ";
-      emitFunctionPointer(os, property.setter);
+      emitFunctionPointer(os, type_names, metrics, property.setter);
     }
     os << ");\n";
   }
@@ -1156,19 +1633,14 @@ void RecordExposer::emitProperties(llvm::raw_ostream &os) {
 
 void RecordExposer::emitAggegateConstructor(llvm::raw_ostream &os) {
   assert(record_decl->isAggregate());
-  const clang::ASTContext &context = record_decl->getASTContext();
-  auto printing_policy = getPrintingPolicyForExposedNames(context);
-  AttemptFullQualificationPrinter printer_helper{context, printing_policy};
 
   std::vector<std::string> types;
   std::vector<std::string> args;
   auto add_aggregate_element = [&](clang::QualType elem_type,
                                    const clang::IdentifierInfo *identifier,
-                                   const clang::Expr *initializer = nullptr) {
-    std::string type = clang::TypeName::getFullyQualifiedName(
-        elem_type, context, printing_policy,
-        /*WithGlobalNsPrefix=*/true);
-    types.push_back(type);
+                                   llvm::StringRef initializer = {}) {
+    llvm::StringRef type = type_names.get(elem_type);
+    types.push_back(type.str());
 
     llvm::SmallString<128> arg(", ::pybind11::arg(");
     llvm::raw_svector_ostream arg_os(arg);
@@ -1176,13 +1648,10 @@ void RecordExposer::emitAggegateConstructor(llvm::raw_ostream &os) {
     emitStringLiteral(arg_os, identifier->getName());
     // Always emit default argument values to emulate implicitly initialized
     // elements in aggregate initialization.
-    if (initializer == nullptr) {
+    if (initializer.empty()) {
       arg_os << ") = " << type << "{}";
     } else {
-      arg_os << ") = ";
-      initializer->printPretty(arg_os, &printer_helper, printing_policy,
-                               /*Indentation=*/0,
-                               /*NewlineSymbol=*/"\n", &context);
+      arg_os << ") = " << initializer;
     }
     args.push_back(arg.str().str());
   };
@@ -1224,9 +1693,14 @@ void RecordExposer::emitAggegateConstructor(llvm::raw_ostream &os) {
       return;
 
     add_aggregate_element(elem_type, field->getIdentifier(),
-                          field->getInClassInitializer());
+                          texts.getInitializer(field));
   }
 
+  countFunction("__init__");
+  ++metrics.defs;
+  metrics.addSignature(
+      (type_names.get(record_decl) + "(" + llvm::join(types, ", ") + ")")
+          .str());
   os << "context.def(::pybind11::init<" << llvm::join(types, ", ") << ">(), ";
   emitStringLiteral(os, "aggregate initialization");
   os << llvm::join(args, "") << ");\n";
@@ -1235,7 +1709,6 @@ void RecordExposer::emitAggegateConstructor(llvm::raw_ostream &os) {
 void RecordExposer::emitOperator(llvm::raw_ostream &os,
                                  const clang::FunctionDecl *function) {
   const clang::ASTContext &ast_context = record_decl->getASTContext();
-  const auto *method = llvm::dyn_cast<clang::CXXMethodDecl>(function);
 
   clang::OverloadedOperatorKind kind = function->getOverloadedOperator();
 
@@ -1269,20 +1742,12 @@ void RecordExposer::emitOperator(llvm::raw_ostream &os,
   // TODO: implement this...
   (void)allow_rewritten_candidates;
 
-  // Determine the parameters a corresponding free function definition would
-  // have.  In particular, prepend an explicit “self” parameter for
-  // member-functions (unless they already have an explicit object parameter).
-  llvm::SmallVector<clang::QualType, 2> parameter_types;
+  // The parameter types have been determined by `prepareDecl`.
+  auto found = operator_parameter_types.find(function);
+  assert(found != operator_parameter_types.end() &&
+         "operator should have been prepared");
+  llvm::ArrayRef<clang::QualType> parameter_types = found->second;
   clang::QualType record_type = ast_context.getTypeDeclType(record_decl);
-  if (method != nullptr && !method->isExplicitObjectMemberFunction()) {
-    // TODO: Consider ref qualifiers.
-    if (method->isConst())
-      record_type = record_type.withConst();
-    parameter_types.push_back(ast_context.getLValueReferenceType(record_type));
-  }
-  for (const clang::ParmVarDecl *param : function->parameters()) {
-    parameter_types.push_back(param->getType());
-  }
 
   bool unary = parameter_types.size() == 1;
 
@@ -1301,31 +1766,36 @@ void RecordExposer::emitOperator(llvm::raw_ostream &os,
         parameter_types.front().getNonReferenceType();
     return !ast_context.hasSameUnqualifiedType(lhs_param_type, record_type);
   }();
+  llvm::StringRef name =
+      unary ? pythonUnaryOperatorName(kind)
+            : pythonBinaryOperatorName(kind, reverse_parameters);
+  countFunction(name);
+  ++num_operator_lambdas;
+  ++metrics.defs;
+  ++metrics.lambdas;
   os << "context.def(";
-  emitStringLiteral(os,
-                    unary ? pythonUnaryOperatorName(kind)
-                          : pythonBinaryOperatorName(kind, reverse_parameters));
+  emitStringLiteral(os, name);
   os << ", ";
-  emitOperatorDefinition(os, ast_context, kind, parameter_types,
+  emitOperatorDefinition(os, type_names, metrics, kind, parameter_types,
                          function->getReturnType(), reverse_parameters);
   os << ", ";
   // TODO: Add support for return value policies, if supported by pybind11.
-  emitStringLiteral(os, getDocstring(function));
+  emitStringLiteral(os, texts.getDocstring(function));
   os << ", ::pybind11::is_operator());\n";
 }
 
 void RecordExposer::emitOperatorDefinition(
-    llvm::raw_ostream &os, const clang::ASTContext &ast_context,
-    clang::OverloadedOperatorKind kind,
-    const llvm::SmallVectorImpl<clang::QualType> &parameter_types,
+    llvm::raw_ostream &os, QualifiedTypeNames &type_names,
+    CodeMetrics &metrics, clang::OverloadedOperatorKind kind,
+    llvm::ArrayRef<clang::QualType> parameter_types,
     clang::QualType return_type, bool reverse_parameters) {
   assert(parameter_types.size() <= 2);
   bool unary = parameter_types.size() == 1;
   llvm::StringRef parameter_names[2] = {"lhs", "rhs"};
-  auto printing_policy = getPrintingPolicyForExposedNames(ast_context);
   os << "[](";
   bool comma = false;
   std::size_t parameter_count = parameter_types.size();
+  llvm::SmallVector<llvm::StringRef, 2> lambda_parameter_types;
   for (auto index : llvm::seq<std::size_t>(0, parameter_count)) {
     std::size_t type_index =
         reverse_parameters ? (parameter_count - 1 - index) : index;
@@ -1333,17 +1803,17 @@ void RecordExposer::emitOperatorDefinition(
       os << ", ";
     // TODO: If the operator decl takes a parameter by value, this wrapper
     // does so, too.  This might not always work or be optimal?
-    os << clang::TypeName::getFullyQualifiedName(parameter_types[type_index],
-                                                 ast_context, printing_policy,
-                                                 /*WithGlobalNsPrefix=*/true);
+    lambda_parameter_types.push_back(
+        type_names.get(parameter_types[type_index]));
+    os << lambda_parameter_types.back();
     os << ' ' << parameter_names[index];
     comma = true;
   }
-  os << ") -> "
-     << clang::TypeName::getFullyQualifiedName(return_type, ast_context,
-                                               printing_policy,
-                                               /*WithGlobalNsPrefix=*/true)
-     << " { return ";
+  const llvm::StringRef lambda_return_type = type_names.get(return_type);
+  metrics.addSignature(("[](" + llvm::join(lambda_parameter_types, ", ") +
+                        ") -> " + lambda_return_type)
+                           .str());
+  os << ") -> " << lambda_return_type << " { return ";
   if (unary) {
     os << getOperatorSpelling(kind) << parameter_names[0];
   } else {
@@ -1355,7 +1825,7 @@ void RecordExposer::emitOperatorDefinition(
 }
 
 void RecordExposer::emitType(llvm::raw_ostream &os) {
-  os << "::pybind11::class_<" << getFullyQualifiedName(record_decl);
+  os << "::pybind11::class_<" << type_names.get(record_decl);
 
   // Add all exposed (i.e. part of graph) public bases as arguments.
   // This is called recursively, since bases of inlined bases also need to
@@ -1372,14 +1842,14 @@ void RecordExposer::emitType(llvm::raw_ostream &os) {
         if (const auto *rd = llvm::dyn_cast<clang::CXXRecordDecl>(base_decl))
           recurse(rd, recurse);
       } else if (graph.getNode(base_decl) != nullptr) {
-        os << ", " << getFullyQualifiedName(base_decl);
+        os << ", " << type_names.get(base_decl);
       }
     }
   };
   maybe_emit_bases(record_decl, maybe_emit_bases);
 
   if (const auto attrs = annotations.get<RecordDeclAttrs>(record_decl);
-      attrs.has_value() && !attrs->holder_type.empty()) {
+      attrs != nullptr && !attrs->holder_type.empty()) {
     os << ", " << attrs->holder_type;
   }
 
@@ -1389,7 +1859,7 @@ void RecordExposer::emitType(llvm::raw_ostream &os) {
 void RecordExposer::handleDeclImpl(llvm::raw_ostream &os,
                                    const clang::NamedDecl *decl) {
   const clang::ASTContext &ast_context = decl->getASTContext();
-  const auto printing_policy = getPrintingPolicyForExposedNames(ast_context);
+  const clang::PrintingPolicy &printing_policy = type_names.getPrintingPolicy();
 
   if (const auto attrs = annotations.get<ConstructorDeclAttrs>(decl)) {
     const auto *constructor = llvm::dyn_cast<clang::CXXConstructorDecl>(decl);
@@ -1400,23 +1870,22 @@ void RecordExposer::handleDeclImpl(llvm::raw_ostream &os,
     if (attrs->implicit_conversion) {
       clang::QualType from_qual_type = constructor->getParamDecl(0)->getType();
       clang::QualType to_qual_type = ast_context.getTypeDeclType(record_decl);
+      ++metrics.implicit_conversions;
+      ++metrics.wrappers;
       os << "::pybind11::implicitly_convertible<"
-         << clang::TypeName::getFullyQualifiedName(from_qual_type, ast_context,
-                                                   printing_policy,
-                                                   /*WithGlobalNsPrefix=*/true)
-         << ", "
-         << clang::TypeName::getFullyQualifiedName(to_qual_type, ast_context,
-                                                   printing_policy,
-                                                   /*WithGlobalNsPrefix=*/true)
-         << ">();\n";
+         << type_names.get(from_qual_type) << ", "
+         << type_names.get(to_qual_type) << ">();\n";
     }
 
+    countFunction("__init__");
+    ++metrics.defs;
+    metrics.addSignature(getSignature(type_names, constructor));
     os << "context.def(::pybind11::init<";
-    emitParameterTypes(os, constructor);
+    emitParameterTypes(os, type_names, constructor);
     os << ">(), ";
-    emitStringLiteral(os, getDocstring(constructor));
-    const auto fn_attrs = annotations.lookup<FunctionDeclAttrs>(decl);
-    emitParameters(os, constructor, fn_attrs);
+    emitStringLiteral(os, texts.getDocstring(constructor));
+    const auto &fn_attrs = annotations.lookup<FunctionDeclAttrs>(decl);
+    emitParameters(os, texts, diagnostics, constructor, fn_attrs);
     emitPolicies(os, fn_attrs);
     os << ");\n";
     return;
@@ -1442,11 +1911,13 @@ void RecordExposer::handleDeclImpl(llvm::raw_ostream &os,
         // ostream operators are only exposed when opted in via
         // `expose_as(__str__)` or similar.
         if (const auto attrs = annotations.get<NamedDeclAttrs>(decl);
-            attrs.has_value() && !attrs->spelling.empty()) {
+            attrs != nullptr && !attrs->spelling.empty()) {
+          countFunction(attrs->spelling);
+          ++metrics.defs;
           os << "context.def(";
           emitStringLiteral(os, attrs->spelling);
           os << ", ::genpybind::string_from_lshift<"
-             << getFullyQualifiedName(record_decl) << ">);\n";
+             << type_names.get(record_decl) << ">);\n";
         }
         return;
       }
@@ -1466,20 +1937,26 @@ void RecordExposer::handleDeclImpl(llvm::raw_ostream &os,
         const clang::CXXMethodDecl *previous =
             std::exchange(properties[name].getter, method);
         if (previous != nullptr) {
-          Diagnostics::report(decl,
-                              Diagnostics::Kind::PropertyAlreadyDefinedError)
-              << name << 0U;
-          Diagnostics::report(previous, clang::diag::note_previous_definition);
+          diagnostics.push_back([decl, previous, name] {
+            Diagnostics::report(decl,
+                                Diagnostics::Kind::PropertyAlreadyDefinedError)
+                << name << 0U;
+            Diagnostics::report(previous,
+                                clang::diag::note_previous_definition);
+          });
         }
       }
       for (auto const &name : method_attrs->setter_for) {
         const clang::CXXMethodDecl *previous =
             std::exchange(properties[name].setter, method);
         if (previous != nullptr) {
-          Diagnostics::report(decl,
-                              Diagnostics::Kind::PropertyAlreadyDefinedError)
-              << name << 1U;
-          Diagnostics::report(previous, clang::diag::note_previous_definition);
+          diagnostics.push_back([decl, previous, name] {
+            Diagnostics::report(decl,
+                                Diagnostics::Kind::PropertyAlreadyDefinedError)
+                << name << 1U;
+            Diagnostics::report(previous,
+                                clang::diag::note_previous_definition);
+          });
         }
       }
       return;
@@ -1489,11 +1966,12 @@ void RecordExposer::handleDeclImpl(llvm::raw_ostream &os,
   if (const auto var_attrs = annotations.get<FieldOrVarDeclAttrs>(decl)) {
     if (var_attrs->manual_bindings != nullptr) {
       assert(!var_attrs->postamble && "postamble only allowed in global scope");
-      emitManualBindings(os, ast_context, var_attrs->manual_bindings);
+      os << texts.getManualBindings(var_attrs->manual_bindings);
       return;
     }
     clang::QualType type = llvm::cast<clang::ValueDecl>(decl)->getType();
     bool readonly = type.isConstQualified() || var_attrs->readonly;
+    ++metrics.defs;
     os << (readonly ? "context.def_readonly" : "context.def_readwrite");
     os << (llvm::isa<clang::VarDecl>(decl) ? "_static(" : "(");
     emitSpelling(os, decl, annotations.lookup<NamedDeclAttrs>(decl));
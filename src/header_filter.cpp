@@ -0,0 +1,46 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "genpybind/header_filter.h"
+
+#include <clang/AST/DeclBase.h>
+#include <clang/Basic/FileEntry.h>
+#include <clang/Basic/SourceManager.h>
+
+using namespace genpybind;
+
+HeaderFilter::HeaderFilter(const clang::SourceManager &source_manager,
+                           llvm::StringRef pattern)
+    : source_manager(source_manager) {
+  if (!pattern.empty())
+    this->pattern.emplace(pattern);
+}
+
+bool HeaderFilter::shouldSkip(const clang::Decl *decl) const {
+  return shouldSkip(decl->getLocation());
+}
+
+bool HeaderFilter::shouldSkip(clang::SourceLocation loc) const {
+  if (loc.isInvalid())
+    return false;
+  // Declarations produced by macros belong to the file of the expansion.
+  const clang::FileID file = source_manager.getFileID(
+      source_manager.getExpansionLoc(loc));
+  if (file == source_manager.getMainFileID())
+    return false;
+
+  auto inserted = skipped_files.try_emplace(file, false);
+  if (!inserted.second)
+    return inserted.first->second;
+
+  bool skip = false;
+  if (clang::OptionalFileEntryRef entry =
+          source_manager.getFileEntryRefForID(file)) {
+    skip = clang::SrcMgr::isSystem(source_manager.getFileCharacteristic(
+               source_manager.getLocForStartOfFile(file))) ||
+           (pattern.has_value() && !pattern->match(entry->getName()));
+  }
+  inserted.first->second = skip;
+  return skip;
+}
@@ -4,9 +4,9 @@
 
 #include "genpybind/instantiate_annotated_templates.h"
 
-#include "genpybind/annotated_decl.h"
+#include "genpybind/options.h"
+#include "genpybind/statistics.h"
 
-#include <clang/AST/ASTContext.h>
 #include <clang/AST/Decl.h>
 #include <clang/AST/DeclCXX.h>
 #include <clang/AST/DeclTemplate.h>
@@ -14,30 +14,75 @@
 #include <clang/Basic/SourceLocation.h>
 #include <clang/Basic/Specifiers.h>
 #include <clang/Sema/Sema.h>
+#include <clang/Sema/Template.h>
 #include <llvm/Support/Casting.h>
 
 #include <cassert>
 
 using namespace genpybind;
 
-void InstantiateAnnotatedTemplatesASTConsumer::HandleTranslationUnit(
-    clang::ASTContext &context) {
-  TraverseDecl(context.getTranslationUnitDecl());
-
-  while (!pending.empty()) {
-    clang::ClassTemplateSpecializationDecl *specialization = pending.front();
-    assert(specialization != nullptr);
-    pending.pop();
-
-    done.insert(specialization);
-    instantiateSpecialization(specialization);
+/// Whether a member has been instantiated from its class template, i.e., it is
+/// not explicitly specialized.
+static bool
+isInstantiatedMember(const clang::MemberSpecializationInfo *info) {
+  return info != nullptr && info->getTemplateSpecializationKind() !=
+                                clang::TSK_ExplicitSpecialization;
+}
 
-    TraverseDecl(specialization->getDefinition());
+/// Instantiate the definitions of the member classes and enumerations of
+/// `record` (recursively), s.t. they can be exposed.  In contrast to
+/// `Sema::InstantiateClassMembers`, member functions are only defined if
+/// their return type needs to be deduced.  (Mirrors the corresponding parts
+/// of `Sema::InstantiateClassMembers`.)
+static void instantiateMemberDeclarations(
+    clang::Sema &sema, clang::SourceLocation loc, clang::CXXRecordDecl *record,
+    const clang::MultiLevelTemplateArgumentList &template_args) {
+  for (clang::Decl *decl : record->decls()) {
+    if (decl->isImplicit())
+      continue;
+
+    if (auto *method = llvm::dyn_cast<clang::CXXMethodDecl>(decl)) {
+      // The return type is needed to spell the type of the method.
+      if (method->getReturnType()->isUndeducedType())
+        sema.DeduceReturnType(method, loc);
+      continue;
+    }
+
+    if (auto *nested = llvm::dyn_cast<clang::CXXRecordDecl>(decl)) {
+      if (nested->getPreviousDecl() != nullptr ||
+          !isInstantiatedMember(nested->getMemberSpecializationInfo()))
+        continue;
+      if (!nested->hasDefinition()) {
+        const clang::CXXRecordDecl *pattern =
+            nested->getInstantiatedFromMemberClass();
+        pattern = pattern != nullptr ? pattern->getDefinition() : nullptr;
+        if (pattern == nullptr)
+          continue;
+        sema.InstantiateClass(loc, nested,
+                              const_cast<clang::CXXRecordDecl *>(pattern),
+                              template_args, clang::TSK_ImplicitInstantiation);
+      }
+      if (clang::CXXRecordDecl *definition = nested->getDefinition())
+        instantiateMemberDeclarations(sema, loc, definition, template_args);
+      continue;
+    }
+
+    if (auto *enum_decl = llvm::dyn_cast<clang::EnumDecl>(decl)) {
+      if (!isInstantiatedMember(enum_decl->getMemberSpecializationInfo()) ||
+          enum_decl->getDefinition() != nullptr)
+        continue;
+      clang::EnumDecl *pattern = enum_decl->getTemplateInstantiationPattern();
+      pattern = pattern != nullptr ? pattern->getDefinition() : nullptr;
+      if (pattern == nullptr)
+        continue;
+      sema.InstantiateEnum(loc, enum_decl, pattern, template_args,
+                           clang::TSK_ImplicitInstantiation);
+    }
   }
 }
 
-void InstantiateAnnotatedTemplatesASTConsumer::instantiateSpecialization(
-    clang::ClassTemplateSpecializationDecl *specialization) {
+bool genpybind::instantiateAnnotatedSpecialization(
+    clang::Sema &sema, clang::ClassTemplateSpecializationDecl *specialization) {
   assert(specialization != nullptr);
   if (auto *definition =
           llvm::cast_or_null<clang::ClassTemplateSpecializationDecl>(
@@ -59,7 +104,10 @@ void InstantiateAnnotatedTemplatesASTConsumer::instantiateSpecialization(
   if (prev_tsk != clang::TSK_Undeclared &&
       prev_tsk != clang::TSK_ImplicitInstantiation &&
       prev_tsk != clang::TSK_ExplicitInstantiationDeclaration)
-    return;
+    return false;
+
+  if (ModuleStatistics *statistics = currentStatistics())
+    ++statistics->instantiated_specializations;
 
   // Put instantiation in enclosing namespace of its template (re-use
   // declaration node, as it should not yet be part of a declaration context).
@@ -81,15 +129,15 @@ void InstantiateAnnotatedTemplatesASTConsumer::instantiateSpecialization(
   clang::SourceLocation loc = specialization->getLocation();
 
   if (prev_tsk == clang::TSK_Undeclared)
-    sema->runWithSufficientStackSpace(loc, [&] {
+    sema.runWithSufficientStackSpace(loc, [&] {
 #if LLVM_VERSION_MAJOR >= 20
-      sema->InstantiateClassTemplateSpecialization(
+      sema.InstantiateClassTemplateSpecialization(
           loc, specialization, tsk,
           /*Complain=*/true,
           specialization->hasMatchedPackOnParmToNonPackOnArg());
 #else
-      sema->InstantiateClassTemplateSpecialization(loc, specialization, tsk,
-                                                   /*Complain=*/true);
+      sema.InstantiateClassTemplateSpecialization(loc, specialization, tsk,
+                                                  /*Complain=*/true);
 #endif
     });
 
@@ -98,28 +146,13 @@ void InstantiateAnnotatedTemplatesASTConsumer::instantiateSpecialization(
   assert(definition != nullptr && definition == specialization);
 
   definition->setSpecializationKind(tsk);
-  sema->runWithSufficientStackSpace(loc, [&] {
-    sema->InstantiateClassTemplateSpecializationMembers(loc, definition, tsk);
+  sema.runWithSufficientStackSpace(loc, [&] {
+    if (getMemberInstantiation() == MemberInstantiation::Declarations) {
+      instantiateMemberDeclarations(
+          sema, loc, definition, sema.getTemplateInstantiationArgs(definition));
+      return;
+    }
+    sema.InstantiateClassTemplateSpecializationMembers(loc, definition, tsk);
   });
-}
-
-bool InstantiateAnnotatedTemplatesASTConsumer::VisitTypedefNameDecl(
-    const clang::TypedefNameDecl *decl) {
-  if (hasAnnotations(decl)) {
-    clang::QualType qual_type = decl->getUnderlyingType();
-    if (auto *specialization =
-            llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
-                qual_type->getAsTagDecl()))
-      if (done.count(specialization) == 0)
-        pending.push(specialization);
-  }
-  return true;
-}
-
-bool InstantiateAnnotatedTemplatesASTConsumer::
-    VisitClassTemplateSpecializationDecl(
-        clang::ClassTemplateSpecializationDecl *decl) {
-  if (done.count(decl) == 0 && hasAnnotations(decl))
-    pending.push(decl);
   return true;
 }
@@ -4,34 +4,75 @@
 
 #include "genpybind/instantiate_default_arguments.h"
 
-#include <clang/AST/ASTContext.h>
 #include <clang/AST/Decl.h>
+#include <clang/AST/DeclTemplate.h>
 #include <clang/Basic/SourceLocation.h>
 #include <clang/Basic/Specifiers.h>
 #include <clang/Sema/Sema.h>
+#include <clang/Sema/TemplateInstCallback.h>
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/Support/Casting.h>
 
+#include <memory>
+
 using namespace genpybind;
 
-void InstantiateDefaultArgumentsASTConsumer::HandleTranslationUnit(
-    clang::ASTContext &context) {
-  TraverseDecl(context.getTranslationUnitDecl());
+void genpybind::instantiateDefaultArguments(
+    clang::Sema &sema, const clang::FunctionDecl *function) {
+  if (function->isInvalidDecl())
+    return;
+
+  // If the specialization is incomplete, there is no point in continuing.
+  if (function->getTemplateSpecializationKind() == clang::TSK_Undeclared)
+    return;
+
+  auto *mutable_function = const_cast<clang::FunctionDecl *>(function);
+  for (clang::ParmVarDecl *param : mutable_function->parameters()) {
+    if (param->hasUnparsedDefaultArg() || !param->hasUninstantiatedDefaultArg())
+      continue;
+    sema.InstantiateDefaultArgument(clang::SourceLocation(), mutable_function,
+                                    param);
+  }
 }
 
-bool InstantiateDefaultArgumentsASTConsumer::VisitParmVarDecl(
-    clang::ParmVarDecl *decl) {
-  if (decl->hasUnparsedDefaultArg() || !decl->hasUninstantiatedDefaultArg())
-    return true;
+namespace {
 
-  auto *function = llvm::dyn_cast<clang::FunctionDecl>(decl->getDeclContext());
-  if (function == nullptr || function->isInvalidDecl())
-    return true;
+class RecordSpecializations : public clang::TemplateInstantiationCallback {
+  std::vector<const clang::ClassTemplateSpecializationDecl *> &specializations;
 
-  // If the specialization is incomplete, there is no point in continuing.
-  if (function->getTemplateSpecializationKind() == clang::TSK_Undeclared)
-    return true;
+public:
+  explicit RecordSpecializations(
+      std::vector<const clang::ClassTemplateSpecializationDecl *>
+          &specializations)
+      : specializations(specializations) {}
+
+  void initialize(const clang::Sema &) override {}
+  void finalize(const clang::Sema &) override {}
+  void atTemplateBegin(const clang::Sema &,
+                       const clang::Sema::CodeSynthesisContext &) override {}
+
+  void atTemplateEnd(const clang::Sema &,
+                     const clang::Sema::CodeSynthesisContext &inst) override {
+    if (inst.Kind != clang::Sema::CodeSynthesisContext::TemplateInstantiation)
+      return;
+    if (const auto *decl =
+            llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+                inst.Entity))
+      specializations.push_back(decl);
+  }
+};
 
-  sema->InstantiateDefaultArgument(clang::SourceLocation(), function, decl);
+} // namespace
+
+InstantiatedSpecializations::InstantiatedSpecializations(clang::Sema &sema)
+    : sema(sema) {
+  auto recorder = std::make_unique<RecordSpecializations>(specializations);
+  callback = recorder.get();
+  sema.TemplateInstCallbacks.push_back(std::move(recorder));
+}
 
-  return true;
+InstantiatedSpecializations::~InstantiatedSpecializations() {
+  llvm::erase_if(sema.TemplateInstCallbacks, [&](const auto &registered) {
+    return registered.get() == callback;
+  });
 }
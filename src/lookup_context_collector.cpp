@@ -6,13 +6,187 @@
 
 #include "genpybind/annotated_decl.h"
 #include "genpybind/diagnostics.h"
+#include "genpybind/instantiate_annotated_templates.h"
 
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclCXX.h>
 #include <clang/AST/Type.h>
+#include <clang/Basic/Diagnostic.h>
 #include <clang/Basic/DiagnosticIDs.h>
+#include <clang/Basic/Specifiers.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/Support/Casting.h>
+#include <llvm/Support/TimeProfiler.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
 
 using namespace genpybind;
 
+/// Remove all but the last occurrence of each item, retaining their order.
+template <typename T> static void keepLastOccurrences(std::vector<T> &items) {
+  llvm::DenseSet<T> seen;
+  std::vector<T> result;
+  result.reserve(items.size());
+  for (auto it = items.rbegin(), end = items.rend(); it != end; ++it) {
+    if (seen.insert(*it).second)
+      result.push_back(*it);
+  }
+  std::reverse(result.begin(), result.end());
+  items = std::move(result);
+}
+
+static bool isWithinSkippedNamespace(const clang::Decl *decl) {
+  for (const clang::DeclContext *context = decl->getDeclContext();
+       context != nullptr; context = context->getParent()) {
+    if (LookupContextCollector::shouldSkip(
+            llvm::dyn_cast<clang::NamespaceDecl>(context)))
+      return true;
+  }
+  return false;
+}
+
+void LookupContextCollector::collect(clang::TranslationUnitDecl *decl) {
+  TraverseDecl(decl);
+  // Traversing these can add further targets.
+  for (std::size_t index = 0; index != filtered_alias_targets.size(); ++index)
+    traverseDeferred(filtered_alias_targets[index],
+                     /*queue_specializations=*/true);
+  if (sema == nullptr)
+    return;
+
+  llvm::TimeTraceScope scope("InstantiateAnnotatedTemplates");
+  while (!pending.empty()) {
+    clang::ClassTemplateSpecializationDecl *specialization = pending.front();
+    pending.pop();
+    if (!done.insert(specialization).second)
+      continue;
+    const bool is_declared_explicitly =
+        specialization->getSpecializationKind() ==
+        clang::TSK_ExplicitInstantiationDeclaration;
+    // Otherwise, the specialization has already been traversed in its
+    // declaration context.
+    if (!instantiateAnnotatedSpecialization(*sema, specialization))
+      continue;
+    const std::size_t first_new_context = lookup_contexts.size();
+    traverseDeferred(specialization->getDefinition(),
+                     /*queue_specializations=*/true);
+    // Explicit instantiation declarations are not moved and thus retain their
+    // original position, only their members are new.
+    if (is_declared_explicitly && first_new_context < lookup_contexts.size() &&
+        lookup_contexts[first_new_context] == specialization)
+      lookup_contexts.erase(lookup_contexts.begin() + first_new_context);
+  }
+
+  while (traverseLateSpecializations()) {
+  }
+
+  // Instantiated specializations that were complete before, e.g. implicit
+  // instantiations, have been visited twice.  Only the traversal after
+  // moving them to the declaration context of their template is retained.
+  removeDuplicates();
+}
+
+void LookupContextCollector::traverseDeferred(clang::Decl *decl,
+                                              bool queue_specializations) {
+  const bool was_queueing = std::exchange(queueing, queue_specializations);
+  const bool was_collecting =
+      std::exchange(collecting, !isWithinSkippedNamespace(decl));
+  // Deferred declarations are traversed even if their header is filtered.
+  RecursiveASTVisitor::TraverseDecl(decl);
+  collecting = was_collecting;
+  queueing = was_queueing;
+}
+
+bool LookupContextCollector::traverseLateSpecializations() {
+  bool traversed = false;
+  // Traversing specializations can add further class templates.
+  for (std::size_t index = 0; index != class_templates.size(); ++index) {
+    // As for `RecursiveASTVisitor::TraverseTemplateInstantiations`, explicit
+    // instantiations and specializations are part of their declaration
+    // context instead.
+    llvm::SmallVector<clang::ClassTemplateSpecializationDecl *, 4> unvisited;
+    for (clang::ClassTemplateSpecializationDecl *specialization :
+         class_templates[index]->specializations()) {
+      for (auto *redecl : specialization->redecls()) {
+        auto *decl = llvm::cast<clang::ClassTemplateSpecializationDecl>(redecl);
+        if (decl->getSpecializationKind() ==
+                clang::TSK_ImplicitInstantiation &&
+            decl->isCompleteDefinition() &&
+            !visited_specializations.contains(decl))
+          unvisited.push_back(decl);
+      }
+    }
+    for (clang::ClassTemplateSpecializationDecl *decl : unvisited) {
+      traverseDeferred(decl, /*queue_specializations=*/false);
+      traversed = true;
+    }
+  }
+  return traversed;
+}
+
+void LookupContextCollector::removeDuplicates() {
+  keepLastOccurrences(lookup_contexts);
+  keepLastOccurrences(aliases);
+}
+
+void LookupContextCollector::insertAnnotations(const clang::NamedDecl *decl) {
+  clang::DiagnosticErrorTrap trap{decl->getASTContext().getDiagnostics()};
+  annotations.insert(decl);
+  if (trap.hasErrorOccurred())
+    saw_annotation_errors = true;
+}
+
+void LookupContextCollector::queueSpecialization(
+    clang::ClassTemplateSpecializationDecl *decl) {
+  if (sema != nullptr && queueing && !done.contains(decl))
+    pending.push(decl);
+}
+
+bool LookupContextCollector::VisitTypedefNameDecl(
+    const clang::TypedefNameDecl *decl) {
+  // Only typedefs with explicit annotations are considered.
+  if (!isAnnotated(decl))
+    return true;
+  clang::TagDecl *target_decl = decl->getUnderlyingType()->getAsTagDecl();
+  if (auto *specialization =
+          llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+              target_decl))
+    queueSpecialization(specialization);
+  if (!collecting || decl->getDeclContext()->isDependentContext())
+    return true;
+  if (target_decl != nullptr && header_filter != nullptr &&
+      header_filter->shouldSkip(target_decl))
+    filtered_alias_targets.insert(target_decl);
+  clang::DiagnosticErrorTrap trap{decl->getASTContext().getDiagnostics()};
+  warnIfAliasHasQualifiers(decl);
+  if (trap.hasErrorOccurred())
+    saw_annotation_errors = true;
+  aliases.push_back(decl);
+  return true;
+}
+
+bool LookupContextCollector::VisitClassTemplateSpecializationDecl(
+    clang::ClassTemplateSpecializationDecl *decl) {
+  if (sema == nullptr)
+    return true;
+  if (decl->isCompleteDefinition())
+    visited_specializations.insert(decl);
+  if (isAnnotated(decl))
+    queueSpecialization(decl);
+  return true;
+}
+
+bool LookupContextCollector::TraverseClassTemplateDecl(
+    clang::ClassTemplateDecl *decl) {
+  // Instantiations are only traversed for the canonical declaration.
+  if (sema != nullptr && decl == decl->getCanonicalDecl())
+    class_templates.insert(decl);
+  return RecursiveASTVisitor::TraverseClassTemplateDecl(decl);
+}
+
 void LookupContextCollector::warnIfAliasHasQualifiers(
     const clang::TypedefNameDecl *decl) {
   clang::QualType qual_type = decl->getUnderlyingType();
@@ -30,6 +204,7 @@ void LookupContextCollector::errorIfAnnotationsDoNotMatchFirstDecl(
   }
   const clang::NamedDecl *first_decl = inserted.first->second;
   if (!annotations.equal(decl, first_decl)) {
+    saw_annotation_errors = true;
     Diagnostics::report(
         decl, Diagnostics::Kind::AnnotationsNeedToMatchFirstDeclError);
     Diagnostics::report(first_decl, clang::diag::note_declared_at);
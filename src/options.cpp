@@ -22,12 +22,29 @@ llvm::cl::bits<Experiment> g_experiments(
                                 "Emit constructors for aggregates")),
     llvm::cl::Hidden);
 
+llvm::cl::opt<MemberInstantiation> g_instantiate_members(
+    "instantiate-members", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Which members of annotated class template specializations are\n"
+        "instantiated:"),
+    llvm::cl::values(
+        clEnumValN(MemberInstantiation::All, "all",
+                   "All members, including function bodies (default)"),
+        clEnumValN(MemberInstantiation::Declarations, "declarations",
+                   "Only member declarations, s.t. function bodies are "
+                   "skipped")),
+    llvm::cl::init(MemberInstantiation::All));
+
 } // namespace
 
 bool genpybind::isEnabled(Experiment experiment) {
   return g_all_experiments || g_experiments.isSet(experiment);
 }
 
+MemberInstantiation genpybind::getMemberInstantiation() {
+  return g_instantiate_members;
+}
+
 llvm::cl::OptionCategory &genpybind::getGenpybindCategory() {
   static llvm::cl::OptionCategory category{"Genpybind options"};
   return category;
@@ -0,0 +1,171 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "genpybind/output_cache.h"
+
+#include "genpybind/pragmas.h"
+
+#include <clang/Basic/SourceLocation.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Basic/TokenKinds.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#include <clang/Lex/PPCallbacks.h>
+#include <clang/Lex/Preprocessor.h>
+#include <clang/Lex/Token.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/BLAKE3.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/ErrorOr.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/TimeProfiler.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace genpybind;
+
+namespace {
+
+class Hasher {
+  llvm::BLAKE3 hasher;
+
+public:
+  void add(llvm::StringRef data) {
+    // Prefix with the size to keep adjacent strings apart.
+    std::uint64_t size = data.size();
+    std::uint8_t encoded_size[sizeof(size)];
+    llvm::support::endian::write64le(encoded_size, size);
+    hasher.update(encoded_size);
+    hasher.update(data);
+  }
+
+  std::string finalize() { return llvm::toHex(hasher.final(), true); }
+};
+
+/// Include the names of all entered files, as they are part of the generated
+/// code (in case of the main file) or could otherwise affect it.
+class FileNameHasher : public clang::PPCallbacks {
+  const clang::SourceManager &source_manager;
+  Hasher &hasher;
+
+public:
+  FileNameHasher(const clang::SourceManager &source_manager, Hasher &hasher)
+      : source_manager(source_manager), hasher(hasher) {}
+
+  void FileChanged(clang::SourceLocation loc, FileChangeReason reason,
+                   clang::SrcMgr::CharacteristicKind file_type,
+                   clang::FileID /*prev_fid*/) override {
+    if (reason != EnterFile)
+      return;
+    hasher.add(source_manager.getFilename(loc));
+    hasher.add(clang::SrcMgr::isSystem(file_type) ? "system" : "user");
+  }
+};
+
+} // namespace
+
+void CacheKeyAction::ExecuteAction() {
+  llvm::TimeTraceScope scope("ComputeCacheKey");
+  clang::CompilerInstance &compiler = getCompilerInstance();
+  clang::Preprocessor &preproc = compiler.getPreprocessor();
+
+  Hasher hasher;
+  hasher.add(salt);
+  for (const std::string &arg : compiler.getInvocation().getCC1CommandLine())
+    hasher.add(arg);
+
+  PragmaGenpybindHandler pragma_handler;
+  preproc.AddPragmaHandler(&pragma_handler);
+  preproc.addPPCallbacks(
+      std::make_unique<FileNameHasher>(compiler.getSourceManager(), hasher));
+  preproc.SetCommentRetentionState(/*KeepComments=*/true,
+                                   /*KeepMacroComments=*/true);
+
+  preproc.EnterMainSourceFile();
+  clang::Token token;
+  do {
+    preproc.Lex(token);
+    hasher.add(clang::tok::getTokenName(token.getKind()));
+    hasher.add(preproc.getSpelling(token));
+  } while (token.isNot(clang::tok::eof));
+
+  preproc.RemovePragmaHandler(&pragma_handler);
+  for (const std::string &include : pragma_handler.getIncludes())
+    hasher.add(include);
+
+  if (compiler.getDiagnostics().hasErrorOccurred())
+    return;
+  key += hasher.finalize();
+}
+
+bool genpybind::fileHasContents(llvm::StringRef path,
+                                llvm::StringRef contents) {
+  llvm::sys::fs::file_status status;
+  if (llvm::sys::fs::status(path, status) ||
+      !llvm::sys::fs::is_regular_file(status) ||
+      status.getSize() != contents.size())
+    return false;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  return buffer && (*buffer)->getBuffer() == contents;
+}
+
+bool OutputCache::restore(llvm::StringRef key,
+                          llvm::ArrayRef<std::string> output_paths) const {
+  llvm::SmallString<128> entry(directory);
+  llvm::sys::path::append(entry, key);
+  if (!llvm::sys::fs::is_directory(entry))
+    return false;
+
+  for (std::size_t idx = 0; idx < output_paths.size(); ++idx) {
+    llvm::SmallString<128> cached(entry);
+    llvm::sys::path::append(cached, llvm::Twine(idx));
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+        llvm::MemoryBuffer::getFile(cached, /*IsText=*/false,
+                                    /*RequiresNullTerminator=*/false);
+    if (!buffer)
+      return false;
+    if (fileHasContents(output_paths[idx], (*buffer)->getBuffer()))
+      continue;
+    if (llvm::sys::fs::copy_file(cached, output_paths[idx]))
+      return false;
+  }
+  return true;
+}
+
+void OutputCache::store(llvm::StringRef key,
+                        llvm::ArrayRef<std::string> output_paths) const {
+  if (llvm::sys::fs::create_directories(directory))
+    return;
+
+  // Populate a temporary directory first, s.t. concurrent processes never
+  // observe incomplete entries.
+  llvm::SmallString<128> entry(directory);
+  llvm::sys::path::append(entry, key);
+  llvm::SmallString<128> temporary;
+  if (llvm::sys::fs::createUniqueDirectory(entry.str() + ".tmp", temporary))
+    return;
+
+  for (std::size_t idx = 0; idx < output_paths.size(); ++idx) {
+    llvm::SmallString<128> cached(temporary);
+    llvm::sys::path::append(cached, llvm::Twine(idx));
+    if (llvm::sys::fs::copy_file(output_paths[idx], cached)) {
+      llvm::sys::fs::remove_directories(temporary);
+      return;
+    }
+  }
+
+  // Fails if another process already added the same entry.
+  if (llvm::sys::fs::rename(temporary, entry))
+    llvm::sys::fs::remove_directories(temporary);
+}
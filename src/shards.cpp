@@ -0,0 +1,185 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "genpybind/shards.h"
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/xxhash.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <utility>
+
+using namespace genpybind;
+
+// Relative weights of the constructs in the generated code.  Each `def` call
+// instantiates a `cpp_function` with its dispatcher, while each distinct
+// signature additionally instantiates argument loaders and casters.
+static constexpr std::uint64_t base_cost = 1;
+static constexpr std::uint64_t def_cost = 10;
+static constexpr std::uint64_t value_cost = 1;
+static constexpr std::uint64_t signature_cost = 5;
+static constexpr std::uint64_t lambda_cost = 5;
+static constexpr std::uint64_t wrapper_cost = 20;
+
+void CodeMetrics::addSignature(std::string signature) {
+  auto it = llvm::lower_bound(signatures, signature);
+  if (it == signatures.end() || *it != signature)
+    signatures.insert(it, std::move(signature));
+}
+
+CodeMetrics &CodeMetrics::operator+=(const CodeMetrics &other) {
+  defs += other.defs;
+  values += other.values;
+  lambdas += other.lambdas;
+  overload_casts += other.overload_casts;
+  implicit_conversions += other.implicit_conversions;
+  wrappers += other.wrappers;
+  bytes += other.bytes;
+  std::vector<std::string> merged;
+  merged.reserve(signatures.size() + other.signatures.size());
+  std::set_union(signatures.begin(), signatures.end(),
+                 other.signatures.begin(), other.signatures.end(),
+                 std::back_inserter(merged));
+  signatures = std::move(merged);
+  return *this;
+}
+
+std::uint64_t genpybind::estimateCompileCost(const CodeMetrics &metrics) {
+  return base_cost + def_cost * metrics.defs + value_cost * metrics.values +
+         signature_cost * metrics.signatures.size() +
+         lambda_cost * metrics.lambdas + wrapper_cost * metrics.wrappers;
+}
+
+bool genpybind::parsePartition(llvm::StringRef spec, unsigned &index,
+                               unsigned &count) {
+  auto [index_text, count_text] = spec.split('/');
+  unsigned parsed_index = 0;
+  unsigned parsed_count = 0;
+  if (index_text.getAsInteger(10, parsed_index) ||
+      count_text.getAsInteger(10, parsed_count) ||
+      parsed_index >= parsed_count)
+    return false;
+  index = parsed_index;
+  count = parsed_count;
+  return true;
+}
+
+unsigned genpybind::shardCountForCostTarget(std::uint64_t total_cost,
+                                            std::uint64_t cost_target,
+                                            unsigned max_shards) {
+  assert(cost_target > 0 && max_shards > 0);
+  const std::uint64_t needed = (total_cost + cost_target - 1) / cost_target;
+  return static_cast<unsigned>(
+      std::clamp<std::uint64_t>(needed, 1, max_shards));
+}
+
+std::vector<std::size_t>
+genpybind::splitAtCostLimit(llvm::ArrayRef<std::uint64_t> costs,
+                            std::uint64_t max_cost) {
+  assert(max_cost > 0);
+  std::vector<std::size_t> result{0};
+  std::uint64_t current = 0;
+  for (std::size_t index = 0; index != costs.size(); ++index) {
+    if (current != 0 && current + costs[index] > max_cost) {
+      result.push_back(index);
+      current = 0;
+    }
+    current += costs[index];
+  }
+  return result;
+}
+
+std::vector<unsigned>
+genpybind::balanceShards(llvm::ArrayRef<std::uint64_t> costs,
+                         unsigned num_shards, std::uint64_t first_shard_cost) {
+  assert(num_shards > 0);
+  // Longest processing time first: Assign the most expensive remaining item
+  // to the shard with the lowest total cost so far.  Ties are broken by
+  // index, to obtain a deterministic result.
+  std::vector<std::size_t> order(costs.size());
+  std::iota(order.begin(), order.end(), std::size_t{0});
+  llvm::stable_sort(order, [&](std::size_t lhs, std::size_t rhs) {
+    return costs[lhs] > costs[rhs];
+  });
+
+  std::vector<std::uint64_t> loads(num_shards, 0);
+  loads.front() = first_shard_cost;
+  std::vector<unsigned> result(costs.size(), 0);
+  for (std::size_t item : order) {
+    auto lightest = std::min_element(loads.begin(), loads.end());
+    *lightest += costs[item];
+    result[item] = static_cast<unsigned>(lightest - loads.begin());
+  }
+  return result;
+}
+
+/// Map `key` to one of `num_buckets` buckets using the "jump consistent hash"
+/// by Lamping and Veach, s.t. changing the number of buckets from n to n + 1
+/// only moves a fraction of 1 / (n + 1) of all keys (to the new bucket).
+static unsigned jumpConsistentHash(std::uint64_t key, unsigned num_buckets) {
+  std::int64_t bucket = -1;
+  std::int64_t next = 0;
+  while (next < num_buckets) {
+    bucket = next;
+    key = key * 2862933555777941757ULL + 1;
+    next = static_cast<std::int64_t>(
+        static_cast<double>(bucket + 1) *
+        (static_cast<double>(std::int64_t{1} << 31) /
+         static_cast<double>((key >> 33) + 1)));
+  }
+  return static_cast<unsigned>(bucket);
+}
+
+std::vector<unsigned>
+genpybind::hashShards(llvm::ArrayRef<llvm::StringRef> keys,
+                      llvm::ArrayRef<std::uint64_t> costs, unsigned num_shards,
+                      std::uint64_t first_shard_cost, double slack) {
+  assert(num_shards > 0 && keys.size() == costs.size());
+  const std::uint64_t total =
+      std::accumulate(costs.begin(), costs.end(), first_shard_cost);
+  const auto capacity = static_cast<std::uint64_t>(
+      std::ceil((1.0 + slack) * static_cast<double>(total) / num_shards));
+
+  std::vector<std::uint64_t> hashes;
+  hashes.reserve(keys.size());
+  for (llvm::StringRef key : keys)
+    hashes.push_back(llvm::xxh3_64bits(key));
+
+  // Items are placed in the order of their hashes instead of their position,
+  // s.t. inserting an item does not affect the placement of unrelated ones.
+  std::vector<std::size_t> order(keys.size());
+  std::iota(order.begin(), order.end(), std::size_t{0});
+  llvm::sort(order, [&](std::size_t lhs, std::size_t rhs) {
+    return std::tie(hashes[lhs], keys[lhs]) < std::tie(hashes[rhs], keys[rhs]);
+  });
+
+  std::vector<std::uint64_t> loads(num_shards, 0);
+  loads.front() = first_shard_cost;
+  std::vector<unsigned> result(keys.size(), 0);
+  for (std::size_t item : order) {
+    const unsigned home = jumpConsistentHash(hashes[item], num_shards);
+    unsigned shard = home;
+    while (loads[shard] + costs[item] > capacity) {
+      shard = (shard + 1) % num_shards;
+      if (shard == home) {
+        // The item does not fit anywhere, fall back to the lightest shard.
+        shard = static_cast<unsigned>(
+            std::min_element(loads.begin(), loads.end()) - loads.begin());
+        break;
+      }
+    }
+    loads[shard] += costs[item];
+    result[item] = shard;
+  }
+  return result;
+}
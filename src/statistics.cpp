@@ -0,0 +1,75 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "genpybind/statistics.h"
+
+#include <llvm/Config/llvm-config.h>
+
+#include <utility>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace genpybind;
+
+static thread_local ModuleStatistics *current_statistics = nullptr;
+
+llvm::json::Value genpybind::toJSON(const ModuleStatistics &statistics) {
+  llvm::json::Object phases;
+  for (const auto &[phase, seconds] : statistics.phase_seconds)
+    phases[phase] = seconds;
+  return llvm::json::Object{
+      {"header", statistics.header},
+      {"module", statistics.module_name},
+      {"cached", statistics.cached},
+      {"instantiated_specializations",
+       statistics.instantiated_specializations},
+      {"annotated_decls", statistics.annotated_decls},
+      {"graph_nodes", statistics.graph_nodes},
+      {"pruned_graph_nodes", statistics.pruned_graph_nodes},
+      {"contexts", statistics.contexts},
+      {"visited_decls", statistics.visited_decls},
+      {"functions", statistics.functions},
+      {"overloads", statistics.overloads},
+      {"operator_lambdas", statistics.operator_lambdas},
+      {"output_bytes", statistics.output_bytes},
+      {"phase_seconds", std::move(phases)},
+  };
+}
+
+ModuleStatistics *genpybind::currentStatistics() { return current_statistics; }
+
+StatisticsScope::StatisticsScope(ModuleStatistics *statistics)
+    : previous(std::exchange(current_statistics, statistics)) {}
+
+StatisticsScope::~StatisticsScope() { current_statistics = previous; }
+
+PhaseTimer::PhaseTimer(llvm::StringRef phase)
+    : statistics(current_statistics), phase(phase),
+      start(std::chrono::steady_clock::now()) {}
+
+PhaseTimer::~PhaseTimer() {
+  if (statistics == nullptr)
+    return;
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  statistics->phase_seconds[phase.str()] += elapsed.count();
+}
+
+std::uint64_t genpybind::getPeakMemoryUsage() {
+#ifdef LLVM_ON_UNIX
+  struct rusage usage = {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+  // Reported in kilobytes on Linux and most BSDs.
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
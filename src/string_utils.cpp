@@ -6,6 +6,7 @@
 
 #include <clang/Basic/CharInfo.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
 
 #include <algorithm>
 
@@ -41,3 +42,13 @@ void genpybind::makeValidIdentifier(llvm::SmallVectorImpl<char> &name) {
     *output++ = '_';
   name.erase(output, end);
 }
+
+std::string
+genpybind::DiscriminateIdentifiers::discriminate(llvm::StringRef name) {
+  auto it = discriminators.try_emplace(name, 0).first;
+  const unsigned discriminator = ++it->getValue();
+  std::string result{name};
+  if (discriminator != 1)
+    result += "_" + llvm::utostr(discriminator);
+  return result;
+}
@@ -7,53 +7,79 @@
 #define GENPYBIND_VERSION_STRING "0.5.1.dev1"
 
 #include "genpybind/annotated_decl.h"
+#include "genpybind/bindings.h"
 #include "genpybind/decl_context_graph.h"
 #include "genpybind/decl_context_graph_builder.h"
 #include "genpybind/decl_context_graph_processing.h"
 #include "genpybind/expose.h"
+#include "genpybind/header_filter.h"
 #include "genpybind/inspect_graph.h"
-#include "genpybind/instantiate_annotated_templates.h"
-#include "genpybind/instantiate_default_arguments.h"
 #include "genpybind/options.h"
+#include "genpybind/output_cache.h"
 #include "genpybind/pragmas.h"
+#include "genpybind/shards.h"
+#include "genpybind/statistics.h"
 #include "genpybind/string_utils.h"
+#include "genpybind/visible_decls.h"
 
 #include <clang/AST/ASTConsumer.h>
 #include <clang/AST/ASTContext.h>
 #include <clang/AST/Decl.h>
 #include <clang/Basic/Diagnostic.h>
 #include <clang/Basic/FileEntry.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/FileSystemOptions.h>
 #include <clang/Basic/SourceManager.h>
+#include <clang/Basic/Stack.h>
 #include <clang/Basic/Version.inc> // IWYU pragma: keep
 #include <clang/Config/config.h>
 #include <clang/Driver/Driver.h>
 #include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#include <clang/Frontend/DependencyOutputOptions.h>
 #include <clang/Frontend/FrontendAction.h>
-#include <clang/Frontend/MultiplexConsumer.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Frontend/FrontendOptions.h>
 #include <clang/Lex/Preprocessor.h>
 #include <clang/Sema/SemaConsumer.h>
+#include <clang/Serialization/PCHContainerOperations.h>
 #include <clang/Tooling/ArgumentsAdjusters.h>
 #include <clang/Tooling/CommonOptionsParser.h>
 #include <clang/Tooling/CompilationDatabase.h>
 #include <clang/Tooling/Tooling.h>
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
 #include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
 #include <llvm/ADT/Twine.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Error.h>
 #include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/ErrorOr.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/Program.h>
+#include <llvm/Support/Regex.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/VirtualFileSystem.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/thread.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <initializer_list>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -96,12 +122,12 @@ llvm::cl::opt<bool>
                llvm::cl::desc("Debug dump the AST after initial augmentation"),
                llvm::cl::init(false), llvm::cl::Hidden);
 
-struct OutputFilenameParser : public llvm::cl::parser<std::string> {
-  OutputFilenameParser(llvm::cl::Option &opt) : parser(opt) {}
+struct AbsolutePathParser : public llvm::cl::parser<std::string> {
+  AbsolutePathParser(llvm::cl::Option &opt) : parser(opt) {}
 
   static bool parse(llvm::cl::Option &opt, llvm::StringRef, llvm::StringRef arg,
                     std::string &value) {
-    // NOTE: Absolute paths are enforced for the output files, since
+    // NOTE: Absolute paths are enforced for input and output files, since
     // `ClangTool::run` changes to a different working directory.
     if (arg != "-" && !llvm::sys::path::is_absolute(arg))
       return opt.error("path has to be absolute!");
@@ -112,7 +138,7 @@ struct OutputFilenameParser : public llvm::cl::parser<std::string> {
   llvm::StringRef getValueName() const override { return "absolute path"; }
 };
 
-llvm::cl::list<std::string, bool, OutputFilenameParser> g_output_files(
+llvm::cl::list<std::string, bool, AbsolutePathParser> g_output_files(
     "o", llvm::cl::cat(getGenpybindCategory()),
     llvm::cl::desc(
         "Path to the output file (\"-\" for stdout); Can be specified multiple "
@@ -131,6 +157,199 @@ llvm::cl::opt<std::string> g_module_name(
                    "from the main input filename."),
     llvm::cl::Optional);
 
+struct RegexParser : public llvm::cl::parser<std::string> {
+  RegexParser(llvm::cl::Option &opt) : parser(opt) {}
+
+  static bool parse(llvm::cl::Option &opt, llvm::StringRef, llvm::StringRef arg,
+                    std::string &value) {
+    std::string error;
+    if (!llvm::Regex(arg).isValid(error))
+      return opt.error("invalid regular expression: " + error);
+    value = arg.str();
+    return false;
+  }
+
+  llvm::StringRef getValueName() const override { return "regex"; }
+};
+
+llvm::cl::opt<std::string, false, RegexParser> g_header_filter(
+    "header-filter", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Only look for declarations to expose in headers whose path matches\n"
+        "this regular expression (and in the main input file).  System\n"
+        "headers are never considered, as they cannot carry annotations."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<bool> g_skip_function_bodies(
+    "skip-function-bodies", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Skip parsing the bodies of functions, which are not needed to\n"
+        "generate bindings (manual bindings and default arguments are still\n"
+        "parsed).  Also applies to --generate-pch."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_include_pch(
+    "include-pch", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc("Use a precompiled header created using --generate-pch.\n"
+                   "All modules sharing it need to use compatible flags."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_generate_pch(
+    "generate-pch", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Instead of generating bindings, write a precompiled header for the\n"
+        "input file (e.g., the common includes of several modules)."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_batch_manifest(
+    "batch", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Generate several modules in one process, as described by a JSON\n"
+        "manifest, i.e., a list of {\"header\", \"module\", \"outputs\"} "
+        "objects.\nAll headers also need to be passed as input files."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<unsigned>
+    g_jobs("j", llvm::cl::cat(getGenpybindCategory()),
+           llvm::cl::desc("Number of worker threads used with --batch\n"
+                          "(default: one per hardware thread)."),
+           llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> g_render_threads(
+    "render-threads", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc("Number of threads used to render the bindings of a module\n"
+                   "(default: 1, 0: one per hardware thread)."),
+    llvm::cl::init(1));
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_cache_dir(
+    "cache-dir", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Directory used to cache generated bindings.  On a cache hit, the\n"
+        "output files are restored without parsing the input file."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_depfile(
+    "depfile", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Write a Makefile-style depfile listing all files that were\n"
+        "read while processing the input file."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_emit_ir(
+    "emit-ir", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Additionally write the bindings in a (JSON-based) intermediate\n"
+        "representation, from which the output files can be regenerated\n"
+        "using --from-ir."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_from_ir(
+    "from-ir", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Generate the output files from an intermediate representation\n"
+        "written by --emit-ir, e.g. to change the number of output files.\n"
+        "The input file is not parsed in this mode."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_cost_report(
+    "cost-report", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Write a report (\"-\" for stdout) listing the constructs emitted for\n"
+        "each exposed context, sorted by estimated compile cost."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_print_stats(
+    "print-stats", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc("Write statistics about the generated modules (e.g., sizes\n"
+                   "of the graph and time spent per phase) as JSON."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<std::string, false, AbsolutePathParser> g_time_trace(
+    "time-trace", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc("Write a time trace in Chrome's trace event format, which\n"
+                   "also includes clang's frontend phases."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<unsigned> g_time_trace_granularity(
+    "time-trace-granularity", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc("Minimum time granularity (in microseconds) traced by\n"
+                   "--time-trace."),
+    llvm::cl::init(500));
+
+llvm::cl::opt<std::uint64_t> g_shard_cost_target(
+    "shard-cost-target", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Estimated compile cost per output file.  If specified, only as many\n"
+        "of the output files are used as necessary; the others are left\n"
+        "empty.  By default, all output files are used.  With\n"
+        "--shard-assignment=hash, a change of the number of used files only\n"
+        "moves a corresponding share of the contexts."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<std::uint64_t> g_max_context_cost(
+    "max-context-cost", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Maximum estimated compile cost per generated function.  Contexts\n"
+        "that exceed it (e.g., classes with many members) are split into\n"
+        "several parts, which can be placed in different output files.\n"
+        "By default, contexts are not split."),
+    llvm::cl::init(0));
+
+struct PartitionParser : public llvm::cl::parser<std::string> {
+  PartitionParser(llvm::cl::Option &opt) : parser(opt) {}
+
+  static bool parse(llvm::cl::Option &opt, llvm::StringRef, llvm::StringRef arg,
+                    std::string &value) {
+    unsigned index = 0;
+    unsigned count = 0;
+    if (!parsePartition(arg, index, count))
+      return opt.error("expected <index>/<count> with index < count!");
+    value = arg.str();
+    return false;
+  }
+
+  llvm::StringRef getValueName() const override { return "index/count"; }
+};
+
+llvm::cl::opt<std::string, false, PartitionParser> g_partition(
+    "partition", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc(
+        "Only emit the definitions of one of several partitions, s.t. the\n"
+        "work can be spread over several processes.  The first partition\n"
+        "(0/<count>) also emits the module definition."),
+    llvm::cl::Optional);
+
+llvm::cl::opt<ShardAssignment> g_shard_assignment(
+    "shard-assignment", llvm::cl::cat(getGenpybindCategory()),
+    llvm::cl::desc("How the generated code is spread over the output files:"),
+    llvm::cl::values(
+        clEnumValN(ShardAssignment::Cost, "cost",
+                   "Balance the estimated compile cost (default)"),
+        clEnumValN(ShardAssignment::Hash, "hash",
+                   "Place contexts by a stable hash of their name, s.t. "
+                   "changes only affect few files")),
+    llvm::cl::init(ShardAssignment::Cost));
+
+/// Configuration of a single module, i.e., everything that differs between the
+/// modules generated in one invocation of the tool.
+struct ModuleJob {
+  std::string header;
+  /// If empty, a valid C identifier is derived from the header filename.
+  std::string module_name;
+  std::vector<std::string> output_files;
+  /// Path of the depfile to write, if any.
+  std::string depfile;
+};
+
+bool fromJSON(const llvm::json::Value &value, ModuleJob &job,
+              llvm::json::Path path) {
+  llvm::json::ObjectMapper mapper(value, path);
+  return mapper && mapper.map("header", job.header) &&
+         mapper.mapOptional("module", job.module_name) &&
+         mapper.map("outputs", job.output_files) &&
+         mapper.mapOptional("depfile", job.depfile);
+}
+
 const char *graphTitle(InspectGraphStage stage) {
   switch (stage) {
   case InspectGraphStage::Visibility:
@@ -155,6 +374,14 @@ void inspectGraph(const DeclContextGraph &graph,
   }
 }
 
+/// Call `fn` within a time trace scope, s.t. its cost shows up in the
+/// `--time-trace` and `--print-stats` output.
+template <typename Fn> decltype(auto) timed(llvm::StringRef name, Fn &&fn) {
+  llvm::TimeTraceScope scope(name);
+  PhaseTimer timer(name);
+  return std::forward<Fn>(fn)();
+}
+
 void emitQuotedArguments(llvm::raw_ostream &os,
                          llvm::ArrayRef<std::string> arguments) {
   bool first = true;
@@ -174,24 +401,74 @@ void emitQuotedArguments(llvm::raw_ostream &os,
   }
 }
 
+/// Collect the options controlling the placement of the generated code.
+ShardingOptions getShardingOptions() {
+  ShardingOptions sharding;
+  sharding.cost_target = g_shard_cost_target;
+  sharding.max_context_cost = g_max_context_cost;
+  sharding.assignment = g_shard_assignment;
+  if (!g_partition.empty())
+    parsePartition(g_partition, sharding.partition, sharding.num_partitions);
+  return sharding;
+}
+
+/// Write `contents` to `path` (via a temporary file), unless the file already
+/// has these contents.
+llvm::Error writeFileIfChanged(llvm::StringRef path, llvm::StringRef contents) {
+  if (path != "-" && fileHasContents(path, contents))
+    return llvm::Error::success();
+  return llvm::writeToOutput(path, [&](llvm::raw_ostream &os) {
+    os << contents;
+    return llvm::Error::success();
+  });
+}
+
+/// Render the given bindings into one buffer per output file.
+std::vector<std::string> renderOutputs(const ModuleBindings &bindings,
+                                       std::size_t num_outputs) {
+  std::vector<std::string> outputs(num_outputs);
+  std::vector<std::unique_ptr<llvm::raw_string_ostream>> output_streams;
+  std::vector<llvm::raw_ostream *> streams;
+  for (std::string &output : outputs) {
+    output_streams.push_back(
+        std::make_unique<llvm::raw_string_ostream>(output));
+    streams.push_back(output_streams.back().get());
+  }
+  timed("EmitBindings",
+        [&] { emitBindings(bindings, streams, getShardingOptions()); });
+  return outputs;
+}
+
+/// Write the report requested via `--cost-report` for the given bindings.
+llvm::Error writeCostReport(llvm::StringRef path,
+                            const ModuleBindings &bindings) {
+  return llvm::writeToOutput(path, [&](llvm::raw_ostream &os) {
+    printCostReport(os, bindings);
+    return llvm::Error::success();
+  });
+}
+
 class GenpybindASTConsumer : public clang::SemaConsumer {
   AnnotationStorage annotations;
   clang::Sema *sema = nullptr;
   clang::CompilerInstance &compiler;
   const genpybind::PragmaGenpybindHandler *pragma_handler;
+  const ModuleJob &job;
+  bool remove_file_on_signal;
 
 public:
   GenpybindASTConsumer(clang::CompilerInstance &compiler,
-                       const genpybind::PragmaGenpybindHandler *pragma_handler)
-      : compiler(compiler), pragma_handler(pragma_handler) {}
+                       const genpybind::PragmaGenpybindHandler *pragma_handler,
+                       const ModuleJob &job, bool remove_file_on_signal)
+      : compiler(compiler), pragma_handler(pragma_handler), job(job),
+        remove_file_on_signal(remove_file_on_signal) {}
 
   // NOLINTNEXTLINE(readability-identifier-naming)
   void InitializeSema(clang::Sema &sema_) override { sema = &sema_; }
   void ForgetSema() override { sema = nullptr; }
 
   void HandleTranslationUnit(clang::ASTContext &context) override {
-    if (g_dump_ast)
-      context.getTranslationUnitDecl()->dump();
+    llvm::TimeTraceScope scope("Genpybind");
 
     const auto &source_manager = context.getSourceManager();
     const llvm::StringRef main_file = [&] {
@@ -201,47 +478,159 @@ public:
       return main_file->getName();
     }();
 
-    if (g_module_name.empty()) {
+    std::string module_name = job.module_name;
+    if (module_name.empty()) {
       llvm::SmallString<128> name = llvm::sys::path::stem(main_file);
       makeValidIdentifier(name);
-      g_module_name = name.str().str();
+      module_name = name.str().str();
     }
 
-    DeclContextGraphBuilder builder(annotations,
-                                    context.getTranslationUnitDecl());
-    auto graph = builder.buildGraph();
+    ModuleStatistics *statistics = currentStatistics();
+    if (statistics != nullptr)
+      statistics->module_name = module_name;
+
+    HeaderFilter header_filter(source_manager, g_header_filter);
+    DeclContextGraphBuilder builder(
+        annotations, context.getTranslationUnitDecl(), sema, &header_filter);
+    auto graph = timed("BuildGraph", [&] { return builder.buildGraph(); });
+    // Dump the AST after it has been prepared by the graph builder.
+    if (g_dump_ast)
+      context.getTranslationUnitDecl()->dump();
     if (!graph.has_value())
       return;
+    if (statistics != nullptr)
+      statistics->graph_nodes = graph->size();
+
+    // Shared by all phases that look up declarations by name.
+    VisibleDeclsCache visible_decls(*sema, &header_filter);
 
-    auto visibilities = deriveEffectiveVisibility(*graph, annotations);
+    auto visibilities = timed("DeriveEffectiveVisibility", [&] {
+      return deriveEffectiveVisibility(*graph, annotations);
+    });
 
     if (reportExposeHereCycles(*graph, reachableDeclContexts(visibilities),
                                builder.getRelocatedDecls(), source_manager))
       return;
 
-    inspectGraph(*graph, annotations, visibilities, g_module_name,
+    inspectGraph(*graph, annotations, visibilities, module_name,
                  InspectGraphStage::Visibility);
 
-    auto contexts_with_visible_decls = declContextsWithVisibleNamedDecls(
-        *sema, &*graph, annotations, visibilities);
+    auto contexts_with_visible_decls =
+        timed("DeclContextsWithVisibleNamedDecls", [&] {
+          return declContextsWithVisibleNamedDecls(visible_decls, &*graph,
+                                                   annotations, visibilities);
+        });
 
     hideNamespacesBasedOnExposeInAnnotation(*graph, annotations,
                                             contexts_with_visible_decls,
-                                            visibilities, g_module_name);
+                                            visibilities, module_name);
 
-    graph = pruneGraph(*graph, contexts_with_visible_decls, visibilities);
+    graph = timed("PruneGraph", [&] {
+      return pruneGraph(*graph, contexts_with_visible_decls, visibilities);
+    });
+    if (statistics != nullptr)
+      statistics->pruned_graph_nodes = graph->size();
 
     reportUnreachableVisibleDeclContexts(*graph, contexts_with_visible_decls,
                                          builder.getRelocatedDecls(),
                                          source_manager);
 
-    inspectGraph(*graph, annotations, visibilities, g_module_name,
+    inspectGraph(*graph, annotations, visibilities, module_name,
                  InspectGraphStage::Pruned);
 
-    std::vector<std::unique_ptr<llvm::raw_pwrite_stream>> output_streams;
-    for (llvm::StringRef output_path : g_output_files) {
+    if (job.output_files.empty())
+      return;
+
+    TranslationUnitExposer exposer(*sema, *graph, visibilities, annotations,
+                                   visible_decls);
+    std::optional<ModuleBindings> bindings = timed("ExposeModule", [&] {
+      unsigned num_threads =
+          g_render_threads != 0
+              ? g_render_threads.getValue()
+              : llvm::hardware_concurrency().compute_thread_count();
+      return exposer.exposeModule(module_name, getShardingOptions(),
+                                  num_threads);
+    });
+
+    // The generated code is buffered, s.t. it can be compared to the existing
+    // output files before any of them are written.
+    std::vector<std::string> outputs(job.output_files.size());
+    if (bindings.has_value()) {
+      {
+        llvm::raw_string_ostream stream(bindings->includes);
+        stream << "#include \"" << main_file << "\"\n"
+               << "#include <genpybind/binding-helpers.h>\n"
+               << "#include <pybind11/pybind11.h>\n";
+
+        if (pragma_handler != nullptr) {
+          for (const std::string &include : pragma_handler->getIncludes()) {
+            stream << "#include " << include << '\n';
+          }
+        }
+        stream << '\n';
+      }
+
+      outputs = renderOutputs(*bindings, job.output_files.size());
+      if (!g_emit_ir.empty())
+        writeIntermediateRepresentation(*bindings);
+      if (!g_cost_report.empty()) {
+        if (llvm::Error error = writeCostReport(g_cost_report, *bindings))
+          reportWriteError(g_cost_report, std::move(error));
+      }
+    }
+
+    if (statistics != nullptr) {
+      statistics->annotated_decls = annotations.size();
+      if (bindings.has_value())
+        statistics->contexts = bindings->contexts.size();
+      for (const std::string &output : outputs)
+        statistics->output_bytes.push_back(output.size());
+    }
+
+    timed("WriteOutputFiles", [&] { writeOutputFiles(outputs); });
+  }
+
+private:
+  void writeIntermediateRepresentation(const ModuleBindings &bindings) {
+    if (compiler.getDiagnostics().hasErrorOccurred())
+      return;
+    std::string contents;
+    {
+      llvm::raw_string_ostream stream(contents);
+      stream << llvm::json::Value(bindings) << '\n';
+    }
+    if (llvm::Error error = writeFileIfChanged(g_emit_ir, contents))
+      reportWriteError(g_emit_ir, std::move(error));
+  }
+
+  void reportWriteError(llvm::StringRef path, llvm::Error error) {
+    clang::DiagnosticsEngine &diagnostics = compiler.getDiagnostics();
+    diagnostics.Report(diagnostics.getCustomDiagID(
+        clang::DiagnosticsEngine::Error, "cannot write '%0': %1"))
+        << path << llvm::toString(std::move(error));
+  }
+
+  /// Write the generated code to the output files.  Files that already have
+  /// the expected contents are left untouched, to preserve their timestamps.
+  /// All other files are written via a temporary file which is renamed by the
+  /// `CompilerInstance` at the end of the action, or discarded on errors (see
+  /// `GenpybindAction::shouldEraseOutputFiles`).
+  void writeOutputFiles(llvm::ArrayRef<std::string> outputs) {
+    const bool erase_output_files =
+        !g_keep_output_files && compiler.getDiagnostics().hasErrorOccurred();
+    for (auto [output_path, contents] : llvm::zip(job.output_files, outputs)) {
+      if (output_path != "-") {
+        // Unchanged files are not registered with the `CompilerInstance`, so
+        // they have to be erased explicitly in order to not leave stale
+        // outputs behind.
+        if (erase_output_files) {
+          llvm::sys::fs::remove(output_path);
+          continue;
+        }
+        if (fileHasContents(output_path, contents))
+          continue;
+      }
       bool binary = false;
-      bool remove_file_on_signal = true; // not thread-safe
       bool use_temporary = true;
       bool create_missing_directories = false;
       auto stream =
@@ -249,42 +638,29 @@ public:
                                     use_temporary, create_missing_directories);
       if (stream == nullptr)
         return;
-      output_streams.push_back(std::move(stream));
-    }
-
-    if (output_streams.empty())
-      return;
-
-    TranslationUnitExposer exposer(*sema, *graph, visibilities, annotations);
-
-    std::string includes;
-    {
-      llvm::raw_string_ostream stream(includes);
-      stream << "#include \"" << main_file << "\"\n"
-             << "#include <genpybind/binding-helpers.h>\n"
-             << "#include <pybind11/pybind11.h>\n";
-
-      if (pragma_handler != nullptr) {
-        for (const std::string &include : pragma_handler->getIncludes()) {
-          stream << "#include " << include << '\n';
-        }
-      }
-      stream << '\n';
-    }
-
-    std::vector<llvm::raw_ostream *> streams;
-    for (const auto &stream : output_streams) {
-      (*stream) << includes;
-      streams.push_back(stream.get());
+      *stream << contents;
     }
-    exposer.emitModule(streams, g_module_name);
   }
 };
 
 class GenpybindAction : public clang::ASTFrontendAction {
   std::unique_ptr<genpybind::PragmaGenpybindHandler> pragma_genpybind_handler;
+  const ModuleJob &job;
+  bool remove_file_on_signal;
 
 public:
+  GenpybindAction(const ModuleJob &job, bool remove_file_on_signal)
+      : job(job), remove_file_on_signal(remove_file_on_signal) {}
+
+  bool BeginInvocation(clang::CompilerInstance &compiler) override {
+    // Manual bindings are lambdas and thus not affected, and clang never skips
+    // bodies that are needed to parse the remaining file, i.e. those of
+    // `constexpr` functions and functions with deduced return types (cf.
+    // `Sema::canSkipFunctionBody`).
+    compiler.getFrontendOpts().SkipFunctionBodies = g_skip_function_bodies;
+    return clang::ASTFrontendAction::BeginInvocation(compiler);
+  }
+
   bool BeginSourceFileAction(clang::CompilerInstance &compiler) override {
     pragma_genpybind_handler =
         std::make_unique<genpybind::PragmaGenpybindHandler>();
@@ -307,14 +683,166 @@ public:
   std::unique_ptr<clang::ASTConsumer>
   CreateASTConsumer(clang::CompilerInstance & /*compiler*/,
                     llvm::StringRef /*in_file*/) override {
-    std::vector<std::unique_ptr<clang::ASTConsumer>> consumers;
-    consumers.push_back(
-        std::make_unique<InstantiateAnnotatedTemplatesASTConsumer>());
-    consumers.push_back(
-        std::make_unique<InstantiateDefaultArgumentsASTConsumer>());
-    consumers.push_back(std::make_unique<GenpybindASTConsumer>(
-        getCompilerInstance(), pragma_genpybind_handler.get()));
-    return std::make_unique<clang::MultiplexConsumer>(std::move(consumers));
+    return std::make_unique<GenpybindASTConsumer>(
+        getCompilerInstance(), pragma_genpybind_handler.get(), job,
+        remove_file_on_signal);
+  }
+};
+
+/// Generate the output files from a previously written intermediate
+/// representation, without parsing the input file.
+int runFromIntermediateRepresentation(
+    llvm::StringRef path, const std::vector<std::string> &output_files) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    llvm::errs() << "error: cannot read '" << path
+                 << "': " << buffer.getError().message() << "\n";
+    return 1;
+  }
+
+  auto bindings = llvm::json::parse<ModuleBindings>(
+      (*buffer)->getBuffer(), "intermediate representation");
+  if (!bindings) {
+    llvm::errs() << "error: " << path << ": "
+                 << llvm::toString(bindings.takeError()) << "\n";
+    return 1;
+  }
+  if (!g_module_name.empty())
+    bindings->module_name = g_module_name;
+
+  const std::vector<std::string> outputs =
+      renderOutputs(*bindings, output_files.size());
+  if (!g_cost_report.empty()) {
+    if (llvm::Error error = writeCostReport(g_cost_report, *bindings)) {
+      llvm::errs() << "error: " << llvm::toString(std::move(error)) << "\n";
+      return 1;
+    }
+  }
+  llvm::TimeTraceScope scope("WriteOutputFiles");
+  for (auto [output_path, contents] : llvm::zip(output_files, outputs)) {
+    if (llvm::Error error = writeFileIfChanged(output_path, contents)) {
+      llvm::errs() << "error: " << llvm::toString(std::move(error)) << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Escape special characters for use as a target in a Makefile rule.
+std::string quoteMakeTarget(llvm::StringRef target) {
+  std::string result;
+  for (std::size_t idx = 0, end = target.size(); idx != end; ++idx) {
+    switch (target[idx]) {
+    case ' ':
+    case '\t':
+      // Escape preceding backslashes.
+      for (std::size_t prev = idx; prev != 0 && target[prev - 1] == '\\';
+           --prev)
+        result += '\\';
+      result += '\\';
+      break;
+    case '$':
+      result += '$';
+      break;
+    case '#':
+      result += '\\';
+      break;
+    default:
+      break;
+    }
+    result += target[idx];
+  }
+  return result;
+}
+
+/// Base class for action factories, which lets the compiler instance write a
+/// Makefile-style depfile for the given targets, if requested.
+class DepfileWritingActionFactory
+    : public clang::tooling::FrontendActionFactory {
+  std::string depfile;
+  std::vector<std::string> targets;
+
+protected:
+  DepfileWritingActionFactory(std::string depfile,
+                              llvm::ArrayRef<std::string> targets)
+      : depfile(std::move(depfile)), targets(targets) {}
+
+public:
+  bool runInvocation(
+      std::shared_ptr<clang::CompilerInvocation> invocation,
+      clang::FileManager *files,
+      std::shared_ptr<clang::PCHContainerOperations> pch_container_ops,
+      clang::DiagnosticConsumer *diag_consumer) override {
+    if (!depfile.empty()) {
+      // Any dependency options in the original command have been stripped by
+      // `getClangStripDependencyFileAdjuster`.
+      clang::DependencyOutputOptions &options =
+          invocation->getDependencyOutputOpts();
+      options.OutputFile = depfile;
+      options.OutputFormat = clang::DependencyOutputFormat::Make;
+      options.IncludeSystemHeaders = true;
+      options.Targets.clear();
+      for (llvm::StringRef target : targets)
+        options.Targets.push_back(quoteMakeTarget(target));
+    }
+    return FrontendActionFactory::runInvocation(
+        std::move(invocation), files, std::move(pch_container_ops),
+        diag_consumer);
+  }
+};
+
+class CacheKeyActionFactory : public DepfileWritingActionFactory {
+  std::string salt;
+  std::string &key;
+
+public:
+  // The depfile is also written here, as it is needed on cache hits.
+  CacheKeyActionFactory(const ModuleJob &job, std::string salt,
+                        std::string &key)
+      : DepfileWritingActionFactory(job.depfile, job.output_files),
+        salt(std::move(salt)), key(key) {}
+
+  std::unique_ptr<clang::FrontendAction> create() override {
+    return std::make_unique<CacheKeyAction>(salt, key);
+  }
+};
+
+class GenpybindActionFactory : public DepfileWritingActionFactory {
+  const ModuleJob &job;
+  bool remove_file_on_signal;
+
+public:
+  GenpybindActionFactory(const ModuleJob &job, bool remove_file_on_signal)
+      : DepfileWritingActionFactory(job.depfile, job.output_files), job(job),
+        remove_file_on_signal(remove_file_on_signal) {}
+
+  std::unique_ptr<clang::FrontendAction> create() override {
+    return std::make_unique<GenpybindAction>(job, remove_file_on_signal);
+  }
+};
+
+/// Writes a precompiled header to the path given via `--generate-pch`, which
+/// can later be used with `--include-pch` to avoid parsing the same include
+/// prefix again for each module.
+class GeneratePrecompiledHeaderAction : public clang::GeneratePCHAction {
+protected:
+  bool BeginInvocation(clang::CompilerInstance &compiler) override {
+    // The output file has been stripped by `getClangStripOutputAdjuster`.
+    compiler.getFrontendOpts().OutputFile = g_generate_pch;
+    compiler.getFrontendOpts().SkipFunctionBodies = g_skip_function_bodies;
+    return clang::GeneratePCHAction::BeginInvocation(compiler);
+  }
+};
+
+class GeneratePrecompiledHeaderActionFactory
+    : public DepfileWritingActionFactory {
+public:
+  GeneratePrecompiledHeaderActionFactory()
+      : DepfileWritingActionFactory(g_depfile, {g_generate_pch}) {}
+
+  std::unique_ptr<clang::FrontendAction> create() override {
+    return std::make_unique<GeneratePrecompiledHeaderAction>();
   }
 };
 
@@ -367,7 +895,7 @@ clang::tooling::ArgumentsAdjuster getDefaultResourceDirAdjuster() {
     result.reserve(arguments.size() + 1);
     auto positional_it = llvm::find(arguments, "--");
     std::copy(arguments.begin(), positional_it, std::back_inserter(result));
-    std::string resource_dir = findResourceDir();
+    static const std::string resource_dir = findResourceDir();
     if (!resource_dir.empty())
       result.push_back("-resource-dir=" + resource_dir);
     std::copy(positional_it, arguments.end(), std::back_inserter(result));
@@ -434,6 +962,252 @@ clang::tooling::ArgumentsAdjuster getCpp17OrLaterAdjuster() {
   };
 }
 
+/// Treat the input as a header file when generating a precompiled header, s.t.
+/// its include guards or `#pragma once` are honored where the PCH is used.
+clang::tooling::ArgumentsAdjuster getHeaderInputAdjuster() {
+  using namespace clang::tooling;
+  return [](const CommandLineArguments &arguments,
+            llvm::StringRef) -> CommandLineArguments {
+    CommandLineArguments result = arguments;
+    auto positional_it = llvm::find(result, "--");
+    std::replace(result.begin(), positional_it, std::string("-xc++"),
+                 std::string("-xc++-header"));
+    return result;
+  };
+}
+
+void appendArgumentsAdjusters(clang::tooling::ClangTool &tool, bool verbose) {
+  using namespace clang::tooling;
+
+  tool.appendArgumentsAdjuster(getClangStripOutputAdjuster());
+  tool.appendArgumentsAdjuster(getClangStripDependencyFileAdjuster());
+  tool.appendArgumentsAdjuster(getClangSyntaxOnlyAdjuster());
+  tool.appendArgumentsAdjuster(getDefaultResourceDirAdjuster());
+  tool.appendArgumentsAdjuster(getCpp17OrLaterAdjuster());
+  tool.appendArgumentsAdjuster(getInsertArgumentAdjuster("-Wno-everything"));
+  tool.appendArgumentsAdjuster(getInsertArgumentAdjuster("-D__GENPYBIND__"));
+
+  if (!g_generate_pch.empty())
+    tool.appendArgumentsAdjuster(getHeaderInputAdjuster());
+  if (!g_include_pch.empty())
+    tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
+        {"-include-pch", g_include_pch}, ArgumentInsertPosition::END));
+
+  if (verbose) {
+    tool.appendArgumentsAdjuster(
+        [](const CommandLineArguments &arguments,
+           llvm::StringRef filename) -> CommandLineArguments {
+          llvm::errs() << "Adjusting command for file " << filename
+                       << " to\n  ";
+          emitQuotedArguments(llvm::errs(), arguments);
+          llvm::errs() << "\n";
+          return arguments;
+        });
+  }
+}
+
+/// Settings shared by all modules generated in one invocation of the tool.
+struct JobSettings {
+  const OutputCache *cache = nullptr;
+  /// Arguments of the tool that can affect the generated code.
+  std::string relevant_arguments;
+  // Registering files for removal on signals is not thread-safe.
+  bool remove_file_on_signal = true;
+  bool verbose = false;
+};
+
+/// Return the arguments of the tool itself that can affect the generated code,
+/// for use in cache keys.  Input and output files and options that only affect
+/// diagnostics or scheduling are excluded.  The compilation command is covered
+/// by the cache key separately, after all adjustments.
+std::string
+getOutputRelevantArguments(llvm::ArrayRef<const char *> arguments,
+                           llvm::ArrayRef<std::string> source_paths) {
+  // Maps to whether the option takes a (possibly separate) value.
+  static const llvm::StringMap<bool> irrelevant_options{
+      {"o", true},           {"batch", true},
+      {"j", true},           {"cache-dir", true},
+      {"depfile", true},     {"p", true},
+      {"module-name", true}, {"time-trace", true},
+      {"print-stats", true}, {"cost-report", true},
+      {"time-trace-granularity", true},
+      {"verbose", false},    {"xfail", false},
+      {"keep-output-files", false},
+  };
+
+  std::string result;
+  for (std::size_t idx = 1; idx < arguments.size(); ++idx) {
+    llvm::StringRef arg = arguments[idx];
+    if (arg == "--")
+      break;
+    if (arg.starts_with("-")) {
+      auto [name, value] = arg.ltrim('-').split('=');
+      auto it = irrelevant_options.find(name);
+      if (it != irrelevant_options.end()) {
+        if (it->second && !arg.contains('='))
+          ++idx;
+        continue;
+      }
+    } else if (llvm::is_contained(source_paths, arg)) {
+      continue;
+    }
+    result += arg;
+    result += '\0';
+  }
+  return result;
+}
+
+/// Generate the bindings for a single module, or restore them from the cache.
+/// If `statistics` is given, it is filled in while generating the module.
+int runJob(clang::tooling::ClangTool &tool, const ModuleJob &job,
+           const JobSettings &settings,
+           ModuleStatistics *statistics = nullptr) {
+  llvm::TimeTraceScope scope("GenerateModule", job.header);
+  StatisticsScope statistics_scope(statistics);
+  PhaseTimer timer("GenerateModule");
+  if (statistics != nullptr)
+    statistics->header = job.header;
+
+  std::string key;
+  if (settings.cache != nullptr && !llvm::is_contained(job.output_files, "-")) {
+    std::string salt;
+    {
+      llvm::raw_string_ostream stream(salt);
+      stream << GENPYBIND_VERSION_STRING << '\0' << CLANG_VERSION_STRING << '\0'
+             << job.module_name << '\0' << job.output_files.size() << '\0'
+             << settings.relevant_arguments;
+    }
+
+    // Any diagnostics are reported when generating the bindings.
+    clang::IgnoringDiagConsumer ignore_diagnostics;
+    tool.setDiagnosticConsumer(&ignore_diagnostics);
+    tool.setPrintErrorMessage(false);
+    CacheKeyActionFactory factory(job, std::move(salt), key);
+    if (tool.run(&factory) != 0)
+      key.clear();
+    tool.setDiagnosticConsumer(nullptr);
+    tool.setPrintErrorMessage(true);
+
+    if (!key.empty() && settings.cache->restore(key, job.output_files)) {
+      if (settings.verbose)
+        llvm::errs() << "Using cached bindings for " << job.header << "\n";
+      if (statistics != nullptr) {
+        statistics->module_name = job.module_name;
+        statistics->cached = true;
+      }
+      return 0;
+    }
+  }
+
+  GenpybindActionFactory factory(job, settings.remove_file_on_signal);
+  const int exit_code = tool.run(&factory);
+  if (exit_code == 0 && !key.empty())
+    settings.cache->store(key, job.output_files);
+  return exit_code;
+}
+
+llvm::Expected<std::vector<ModuleJob>> readBatchManifest(llvm::StringRef path) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(path);
+  if (!buffer)
+    return llvm::createFileError(path, buffer.getError());
+
+  auto jobs = llvm::json::parse<std::vector<ModuleJob>>(
+      (*buffer)->getBuffer(), "batch manifest");
+  if (!jobs)
+    return llvm::createFileError(path, jobs.takeError());
+
+  for (ModuleJob &job : *jobs) {
+    job.header = clang::tooling::getAbsolutePath(job.header);
+    if (job.output_files.empty())
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "no output files specified for '" +
+                                         job.header + "'");
+    // As on the command line, since the working directory may change.
+    if (!job.depfile.empty() && !llvm::sys::path::is_absolute(job.depfile))
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "depfile path '" + job.depfile +
+                                         "' has to be absolute");
+    for (llvm::StringRef output_path : job.output_files) {
+      if (!llvm::sys::path::is_absolute(output_path))
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "output path '" + output_path +
+                                           "' has to be absolute");
+    }
+  }
+  return jobs;
+}
+
+/// Processes all jobs in a pool of worker threads, which share the parsed
+/// compilation database.  Each worker reuses its file manager (and thus the
+/// cached file system lookups) across the modules it generates.  If
+/// `statistics` is not empty, it holds one entry per job.
+int runBatch(const clang::tooling::CompilationDatabase &compilations,
+             llvm::ArrayRef<ModuleJob> jobs, unsigned num_threads,
+             const JobSettings &settings,
+             llvm::MutableArrayRef<ModuleStatistics> statistics) {
+  std::atomic<std::size_t> next_job = 0;
+  std::atomic<bool> failed = false;
+
+  auto work = [&](bool on_worker_thread) {
+    // The time trace profiler is thread-local, see `main`.
+    const bool trace_thread = on_worker_thread && !g_time_trace.empty();
+    if (trace_thread)
+      llvm::timeTraceProfilerInitialize(g_time_trace_granularity,
+                                        "genpybind-tool");
+
+    // `ClangTool::run` changes the working directory of the file system, which
+    // would affect the whole process for the real file system.
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system(
+        llvm::vfs::createPhysicalFileSystem().release());
+    auto files = llvm::makeIntrusiveRefCnt<clang::FileManager>(
+        clang::FileSystemOptions(), file_system);
+
+    for (std::size_t idx = next_job++; idx < jobs.size(); idx = next_job++) {
+      const ModuleJob &job = jobs[idx];
+      clang::tooling::ClangTool tool(
+          compilations, {job.header},
+          std::make_shared<clang::PCHContainerOperations>(), file_system,
+          files);
+      appendArgumentsAdjusters(tool, settings.verbose);
+      if (runJob(tool, job, settings,
+                 statistics.empty() ? nullptr : &statistics[idx]) != 0)
+        failed = true;
+    }
+
+    if (trace_thread)
+      llvm::timeTraceProfilerFinishThread();
+  };
+
+  std::vector<llvm::thread> workers;
+  for (unsigned idx = 1; idx < num_threads; ++idx)
+    workers.emplace_back(clang::DesiredStackSize, work,
+                         /*on_worker_thread=*/true);
+  work(/*on_worker_thread=*/false);
+  for (llvm::thread &worker : workers)
+    worker.join();
+
+  return failed ? 1 : 0;
+}
+
+/// Write the statistics of all generated modules, together with process-wide
+/// numbers, to `path`.
+llvm::Error writeStatistics(llvm::StringRef path,
+                            llvm::ArrayRef<ModuleStatistics> statistics) {
+  llvm::json::Array modules;
+  for (const ModuleStatistics &module : statistics)
+    modules.push_back(module);
+  llvm::json::Value report = llvm::json::Object{
+      {"version", GENPYBIND_VERSION_STRING},
+      {"peak_rss_bytes", getPeakMemoryUsage()},
+      {"modules", std::move(modules)},
+  };
+  return llvm::writeToOutput(path, [&](llvm::raw_ostream &os) {
+    os << llvm::formatv("{0:2}", report) << '\n';
+    return llvm::Error::success();
+  });
+}
+
 void printVersion(llvm::raw_ostream &os) {
   os << "genpybind version " GENPYBIND_VERSION_STRING << "\n";
 }
@@ -455,8 +1229,8 @@ int main(int argc, const char **argv) {
                               llvm::cl::desc("Use verbose output"),
                               llvm::cl::init(false));
 
-  // Only accept one source path, since the current implementation only allows
-  // one set of output files.
+  // Several source paths are only accepted in batch mode, since each module
+  // needs its own set of output files.
   auto expected_parser =
       CommonOptionsParser::create(argc, argv, getGenpybindCategory(),
                                   /*OccurrencesFlag=*/llvm::cl::Required);
@@ -467,6 +1241,39 @@ int main(int argc, const char **argv) {
   }
   CommonOptionsParser &options_parser = expected_parser.get();
 
+  // Errors in the arguments are subject to `--xfail` as well.
+  const auto invalid_arguments = [&] { return expect_failure ? 0 : 1; };
+
+  const bool batch_mode = !g_batch_manifest.empty();
+  if (batch_mode && (!g_output_files.empty() || !g_module_name.empty() ||
+                     !g_generate_pch.empty() || !g_depfile.empty() ||
+                     !g_emit_ir.empty() || !g_from_ir.empty() ||
+                     !g_cost_report.empty())) {
+    llvm::errs() << "error: --batch cannot be combined with -o, --module-name, "
+                    "--depfile, --generate-pch, --emit-ir, --from-ir or "
+                    "--cost-report\n";
+    return invalid_arguments();
+  }
+
+  // Partitions only contain part of the bindings, while the intermediate
+  // representation is expected to be complete.
+  if (!g_partition.empty() && (!g_emit_ir.empty() || !g_from_ir.empty())) {
+    llvm::errs() << "error: --partition cannot be combined with --emit-ir or "
+                    "--from-ir\n";
+    return invalid_arguments();
+  }
+
+  if (!g_emit_ir.empty() && !g_from_ir.empty()) {
+    llvm::errs() << "error: --emit-ir cannot be combined with --from-ir\n";
+    return invalid_arguments();
+  }
+
+  if (!g_partition.empty() && g_max_context_cost != 0) {
+    llvm::errs() << "error: --partition cannot be combined with "
+                    "--max-context-cost\n";
+    return invalid_arguments();
+  }
+
   if (g_output_files.empty())
     g_output_files.push_back("-");
 
@@ -474,7 +1281,10 @@ int main(int argc, const char **argv) {
   const std::vector<std::string> &source_paths =
       options_parser.getSourcePathList();
 
-  assert(source_paths.size() == 1);
+  if (!batch_mode && source_paths.size() != 1) {
+    llvm::errs() << "error: expected a single input file (or --batch)\n";
+    return invalid_arguments();
+  }
 
   if (verbose) {
     for (const auto &source_path : source_paths) {
@@ -492,30 +1302,101 @@ int main(int argc, const char **argv) {
     }
   }
 
-  ClangTool tool(compilations, source_paths);
+  std::optional<OutputCache> cache;
+  // Inspection and dump options would be silently ignored on cache hits, and
+  // neither the intermediate representation nor the cost report are cached.
+  if (!g_cache_dir.empty() && !g_dump_ast && g_dump_graph.empty() &&
+      g_inspect_graph.empty() && g_emit_ir.empty() && g_cost_report.empty())
+    cache.emplace(g_cache_dir);
+
+  JobSettings settings;
+  settings.cache = cache ? &*cache : nullptr;
+  settings.relevant_arguments =
+      getOutputRelevantArguments(llvm::ArrayRef(argv, argc), source_paths);
+  settings.remove_file_on_signal = !batch_mode;
+  settings.verbose = verbose;
+
+  // Clang's own frontend phases are recorded as soon as the profiler is
+  // initialized, which makes them part of the same trace.
+  if (!g_time_trace.empty())
+    llvm::timeTraceProfilerInitialize(g_time_trace_granularity,
+                                      "genpybind-tool");
+
+  // Modules in the order of the batch manifest, or the single module.
+  std::vector<ModuleStatistics> statistics;
+
+  int exit_code = 0;
+  if (batch_mode) {
+    auto jobs = readBatchManifest(g_batch_manifest);
+    if (!jobs) {
+      llvm::errs() << "error: " << llvm::toString(jobs.takeError()) << "\n";
+      return invalid_arguments();
+    }
 
-  tool.appendArgumentsAdjuster(getClangStripOutputAdjuster());
-  tool.appendArgumentsAdjuster(getClangStripDependencyFileAdjuster());
-  tool.appendArgumentsAdjuster(getClangSyntaxOnlyAdjuster());
-  tool.appendArgumentsAdjuster(getDefaultResourceDirAdjuster());
-  tool.appendArgumentsAdjuster(getCpp17OrLaterAdjuster());
-  tool.appendArgumentsAdjuster(getInsertArgumentAdjuster("-Wno-everything"));
-  tool.appendArgumentsAdjuster(getInsertArgumentAdjuster("-D__GENPYBIND__"));
+    // Input files are required to locate the compilation database.  Insist on
+    // a one-to-one match to catch outdated manifests.
+    llvm::StringSet<> inputs;
+    for (const auto &source_path : source_paths)
+      inputs.insert(getAbsolutePath(source_path));
+    llvm::StringSet<> listed;
+    for (const ModuleJob &job : *jobs) {
+      if (!inputs.contains(job.header)) {
+        llvm::errs() << "error: '" << job.header
+                     << "' from batch manifest is not an input file\n";
+        return invalid_arguments();
+      }
+      listed.insert(job.header);
+    }
+    if (listed.size() != inputs.size()) {
+      llvm::errs() << "error: all input files need to be listed in the batch "
+                      "manifest\n";
+      return invalid_arguments();
+    }
 
-  if (verbose) {
-    tool.appendArgumentsAdjuster(
-        [](const CommandLineArguments &arguments,
-           llvm::StringRef filename) -> CommandLineArguments {
-          llvm::errs() << "Adjusting command for file " << filename
-                       << " to\n  ";
-          emitQuotedArguments(llvm::errs(), arguments);
-          llvm::errs() << "\n";
-          return arguments;
-        });
+    unsigned num_threads =
+        g_jobs != 0 ? g_jobs.getValue()
+                    : llvm::hardware_concurrency().compute_thread_count();
+    num_threads = std::clamp(num_threads, 1U,
+                             static_cast<unsigned>(jobs->size()));
+    if (!g_print_stats.empty())
+      statistics.resize(jobs->size());
+    exit_code =
+        runBatch(compilations, *jobs, num_threads, settings, statistics);
+  } else if (!g_from_ir.empty()) {
+    exit_code = runFromIntermediateRepresentation(
+        g_from_ir, {g_output_files.begin(), g_output_files.end()});
+  } else {
+    ClangTool tool(compilations, source_paths);
+    appendArgumentsAdjusters(tool, verbose);
+
+    if (!g_generate_pch.empty()) {
+      GeneratePrecompiledHeaderActionFactory factory;
+      exit_code = tool.run(&factory);
+    } else {
+      ModuleJob job{source_paths.front(), g_module_name,
+                    {g_output_files.begin(), g_output_files.end()}, g_depfile};
+      if (!g_print_stats.empty())
+        statistics.resize(1);
+      exit_code = runJob(tool, job, settings,
+                         statistics.empty() ? nullptr : &statistics.front());
+    }
+  }
+
+  if (!g_print_stats.empty()) {
+    if (llvm::Error error = writeStatistics(g_print_stats, statistics)) {
+      llvm::errs() << "error: " << llvm::toString(std::move(error)) << "\n";
+      exit_code = 1;
+    }
   }
 
-  auto factory = newFrontendActionFactory<GenpybindAction>();
+  if (!g_time_trace.empty()) {
+    if (llvm::Error error =
+            llvm::timeTraceProfilerWrite(g_time_trace, g_time_trace)) {
+      llvm::errs() << "error: " << llvm::toString(std::move(error)) << "\n";
+      exit_code = 1;
+    }
+    llvm::timeTraceProfilerCleanup();
+  }
 
-  const int exit_code = tool.run(factory.get());
   return expect_failure ? static_cast<int>(exit_code == 0) : exit_code;
 }
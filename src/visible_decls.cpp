@@ -6,6 +6,7 @@
 
 #include "genpybind/annotated_decl.h"
 #include "genpybind/decl_context_graph.h"
+#include "genpybind/header_filter.h"
 
 #include <clang/AST/ASTContext.h>
 #include <clang/AST/CXXInheritance.h>
@@ -31,6 +32,7 @@ namespace {
 
 class ExposableDeclConsumer : public clang::VisibleDeclConsumer {
   std::optional<RecordInliningPolicy> inlining_policy;
+  const HeaderFilter *header_filter;
   std::vector<const clang::NamedDecl *> &decls;
 
   static bool isConstructor(const clang::Decl *decl) {
@@ -41,8 +43,10 @@ class ExposableDeclConsumer : public clang::VisibleDeclConsumer {
 
 public:
   ExposableDeclConsumer(std::optional<RecordInliningPolicy> inlining_policy,
+                        const HeaderFilter *header_filter,
                         std::vector<const clang::NamedDecl *> &decls)
-      : inlining_policy(std::move(inlining_policy)), decls(decls) {}
+      : inlining_policy(std::move(inlining_policy)),
+        header_filter(header_filter), decls(decls) {}
 
   bool shouldInlineDecl(clang::NamedDecl *proposed_decl) {
     // TODO: What about using declarations? Where should they be resolved?
@@ -81,6 +85,9 @@ public:
     if (!proposed_decl->getLocation().isValid())
       return;
 
+    if (header_filter != nullptr && header_filter->shouldSkip(proposed_decl))
+      return;
+
     decls.push_back(proposed_decl);
   }
 };
@@ -158,15 +165,22 @@ bool RecordInliningPolicy::shouldHide(const clang::TagDecl *decl) const {
   return hide_bases.count(decl) != 0;
 }
 
+bool RecordInliningPolicy::operator==(const RecordInliningPolicy &other) const {
+  return inline_bases == other.inline_bases && hide_bases == other.hide_bases;
+}
+
 std::vector<const clang::NamedDecl *>
 genpybind::collectVisibleDeclsFromDeclContext(
     clang::Sema &sema, const clang::DeclContext *decl_context,
-    std::optional<RecordInliningPolicy> inlining_policy) {
+    std::optional<RecordInliningPolicy> inlining_policy,
+    const HeaderFilter *header_filter) {
   std::vector<const clang::NamedDecl *> decls;
-  ExposableDeclConsumer consumer(std::move(inlining_policy), decls);
   // Include global scope *iff* looking up decls in the TU decl context.
   bool include_global_scope = llvm::dyn_cast<clang::Decl>(decl_context) ==
                               sema.getASTContext().getTranslationUnitDecl();
+  ExposableDeclConsumer consumer(std::move(inlining_policy),
+                                 include_global_scope ? header_filter : nullptr,
+                                 decls);
   sema.LookupVisibleDecls(const_cast<clang::DeclContext *>(decl_context),
                           clang::Sema::LookupOrdinaryName, consumer,
                           /*IncludeGlobalScope=*/include_global_scope,
@@ -174,3 +188,20 @@ genpybind::collectVisibleDeclsFromDeclContext(
                           /*LoadExternal=*/true);
   return decls;
 }
+
+const std::vector<const clang::NamedDecl *> &VisibleDeclsCache::get(
+    const clang::DeclContext *decl_context,
+    const std::optional<RecordInliningPolicy> &inlining_policy) {
+  auto &candidates = entries[decl_context->getPrimaryContext()];
+  for (const Entry *entry : candidates) {
+    if (entry->inlining_policy == inlining_policy)
+      return entry->decls;
+  }
+  Entry &entry = storage.emplace_back(
+      Entry{inlining_policy,
+            collectVisibleDeclsFromDeclContext(sema, decl_context,
+                                               inlining_policy,
+                                               header_filter)});
+  candidates.push_back(&entry);
+  return entry.decls;
+}
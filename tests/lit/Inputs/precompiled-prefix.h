@@ -0,0 +1,11 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+namespace prefix GENPYBIND(module) {
+struct GENPYBIND(visible) FromPrefix {};
+} // namespace prefix
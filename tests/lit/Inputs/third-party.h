@@ -0,0 +1,14 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+namespace third_party GENPYBIND(visible) {
+struct Unrelated {};
+struct Exposed {
+  struct Nested {};
+};
+} // namespace third_party
@@ -0,0 +1,27 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: echo '[{"header": "%s", "module": "first", "outputs": ["%t-first.cpp"]},' \
+// RUN:      ' {"header": "%s", "outputs": ["%t-second-a.cpp", "%t-second-b.cpp"]}]' \
+// RUN:      > %t.json
+// RUN: genpybind-tool --batch=%t.json -j 2 %s -- %INCLUDES%
+// RUN: FileCheck %s --check-prefix=FIRST < %t-first.cpp
+// RUN: FileCheck %s --check-prefix=SECOND < %t-second-a.cpp
+// RUN: FileCheck %s --check-prefix=INCLUDES < %t-second-b.cpp
+// RUN: genpybind-tool --xfail --batch=%t.json -o=%t.cpp %s -- %INCLUDES% 2>&1 \
+// RUN: | FileCheck %s --check-prefix=CONFLICT
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+struct GENPYBIND(visible) Example {};
+
+// FIRST:     PYBIND11_MODULE(first, root) {
+
+// SECOND:    PYBIND11_MODULE(batch_mode_generates_several_modules, root) {
+
+// INCLUDES:  #include "{{.*}}batch-mode-generates-several-modules.h"
+
+// CONFLICT:  error: --batch cannot be combined with -o
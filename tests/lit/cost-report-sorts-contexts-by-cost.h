@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --cost-report=- -o=%t.cpp %s -- %INCLUDES% \
+// RUN: | FileCheck %s
+// RUN: genpybind-tool --emit-ir=%t.json -o=%t.cpp %s -- %INCLUDES%
+// RUN: genpybind-tool --from-ir=%t.json --cost-report=- -o=%t-ir.cpp %s -- \
+// RUN: | FileCheck %s
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+struct GENPYBIND(visible) Small {
+  void only();
+};
+
+struct GENPYBIND(visible) Large {
+  Large();
+  Large(int value) GENPYBIND(implicit_conversion);
+
+  void first();
+  void first(int);
+  void second(double);
+
+  Large operator-() const;
+};
+
+// Only the generated constructs are counted, not the contents of docstrings.
+// Overloads that only differ in qualifiers have distinct signatures.
+struct GENPYBIND(visible) Documented {
+  /// Forwards to context.def("other", [](int) {}) via overload_cast<int>.
+  void only();
+  void only() const;
+};
+
+// CHECK:      cost defs signatures lambdas overload_casts conversions bytes context
+// CHECK-NEXT: {{[0-9]+}} 6 6 1 3 1 {{[0-9]+}} context_Large
+// CHECK-NEXT: {{[0-9]+}} 2 2 0 2 0 {{[0-9]+}} context_Documented
+// CHECK-NEXT: {{[0-9]+}} 1 1 0 1 0 {{[0-9]+}} context_Small
+// CHECK-NEXT: {{[0-9]+}} 0 0 0 0 0 {{[0-9]+}} context{{$}}
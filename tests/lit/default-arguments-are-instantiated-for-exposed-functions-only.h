@@ -0,0 +1,28 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool -o=%t.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s < %t.cpp
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+template <typename T> struct Defaults {
+  void method(T value = T(42));
+};
+
+typedef Defaults<int> IntDefaults GENPYBIND(expose_here);
+
+// The default argument is ill-formed for `int`, which is only diagnosed if it
+// is instantiated.
+template <typename T> struct Unexposed {
+  void method(T value = T::missing());
+};
+
+namespace detail {
+inline Unexposed<int> instance;
+} // namespace detail
+
+// CHECK: ::pybind11::arg("value") = {{.*}}42
@@ -0,0 +1,16 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --depfile=%t.d -o=%t.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s --strict-whitespace < %t.d
+
+#pragma once
+
+#include "Inputs/precompiled-prefix.h"
+
+#include <genpybind/genpybind.h>
+
+// CHECK:     {{.*}}.cpp: {{.*}}depfile-lists-included-files.h
+// CHECK-DAG: Inputs{{/|\\}}precompiled-prefix.h
+// CHECK-DAG: genpybind{{/|\\}}genpybind.h
@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool -dump-graph=pruned %s -- %INCLUDES% -I%S/Inputs 2>&1 \
+// RUN: | FileCheck %s --check-prefix=ALL --strict-whitespace
+// RUN: genpybind-tool -dump-graph=pruned --header-filter=does-not-match %s \
+// RUN:   -- %INCLUDES% -I%S/Inputs 2>&1 \
+// RUN: | FileCheck %s --check-prefix=FILTERED --strict-whitespace
+// RUN: genpybind-tool -dump-graph=pruned %s -- %INCLUDES% -isystem %S/Inputs \
+// RUN:   2>&1 | FileCheck %s --check-prefix=FILTERED --strict-whitespace
+
+#pragma once
+
+#include <third-party.h>
+
+#include <genpybind/genpybind.h>
+
+namespace local GENPYBIND(visible) {
+struct Local {};
+using Alias GENPYBIND(expose_here) = third_party::Exposed;
+} // namespace local
+
+// ALL:      Declaration context graph after pruning:
+// ALL-NEXT: |-Namespace 'third_party': visible
+// ALL-NEXT: | `-CXXRecord 'third_party::Unrelated': visible
+// ALL-NEXT: `-Namespace 'local': visible
+// ALL-NEXT:   |-CXXRecord 'third_party::Exposed' as 'Alias': visible
+// ALL-NEXT:   | `-CXXRecord 'third_party::Exposed::Nested': visible
+// ALL-NEXT:   `-CXXRecord 'local::Local': visible
+
+// Contexts in other headers are only considered if they are exposed via an
+// alias in one of the considered headers.
+
+// FILTERED:      Declaration context graph after pruning:
+// FILTERED-NEXT: `-Namespace 'local': visible
+// FILTERED-NEXT:   |-CXXRecord 'third_party::Exposed' as 'Alias': visible
+// FILTERED-NEXT:   | `-CXXRecord 'third_party::Exposed::Nested': visible
+// FILTERED-NEXT:   `-CXXRecord 'local::Local': visible
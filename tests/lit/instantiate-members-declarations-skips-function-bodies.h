@@ -0,0 +1,28 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --instantiate-members=declarations -o=%t.cpp %s \
+// RUN:   -- %INCLUDES%
+// RUN: FileCheck %s < %t.cpp
+// RUN: genpybind-tool --xfail %s -- %INCLUDES% 2>&1 \
+// RUN: | FileCheck %s --check-prefix=ALL
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+template <typename T> struct Example {
+  // The body is ill-formed for `int`, which is only diagnosed if it is
+  // instantiated.
+  void heavy() { T::missing(); }
+  // The body is needed to deduce the return type.
+  auto deduced() { return T(); }
+};
+
+typedef Example<int> IntExample GENPYBIND(expose_here);
+
+// CHECK: "heavy"
+// CHECK: "deduced"
+
+// ALL: error: type 'int' cannot be used prior to '::' because it has no members
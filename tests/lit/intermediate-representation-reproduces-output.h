@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --emit-ir=%t.json -o=%t.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s --check-prefix=IR < %t.json
+// RUN: genpybind-tool --from-ir=%t.json -o=%t-ir.cpp %s --
+// RUN: diff %t.cpp %t-ir.cpp
+// RUN: genpybind-tool -o=%t-a.cpp -o=%t-b.cpp %s -- %INCLUDES%
+// RUN: genpybind-tool --from-ir=%t.json -o=%t-ir-a.cpp -o=%t-ir-b.cpp %s --
+// RUN: diff %t-a.cpp %t-ir-a.cpp
+// RUN: diff %t-b.cpp %t-ir-b.cpp
+// RUN: sed -e 's/"version":2/"version":0/' %t.json > %t-old.json
+// RUN: genpybind-tool --xfail --from-ir=%t-old.json -o=%t-old.cpp %s -- \
+// RUN: 2>&1 | FileCheck %s --check-prefix=VERSION
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+/// Docstring.
+struct GENPYBIND(visible) Example {
+  void method(int value = 5);
+};
+
+struct GENPYBIND(visible) Other {
+  Other(int);
+};
+
+// IR:      "contexts":[
+// IR-SAME: "identifier":"context_Example"
+// IR-SAME: "version":2
+
+// VERSION: error: {{.*}}unsupported version
@@ -0,0 +1,41 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --max-context-cost=40 -o=%t-a.cpp -o=%t-b.cpp %s \
+// RUN:   -- %INCLUDES%
+// RUN: cat %t-a.cpp %t-b.cpp | FileCheck %s
+// RUN: genpybind-tool -o=%t.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s --check-prefix=UNSPLIT < %t.cpp
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+struct GENPYBIND(visible) Large {
+  void first();
+  void second();
+  void third();
+  void fourth();
+};
+
+struct GENPYBIND(visible) Small {
+  void only();
+};
+
+// CHECK:      void expose_context_Large_part1(
+// CHECK-NEXT: void expose_context_Large_part2(
+// CHECK-NEXT: void expose_context_Small(
+// CHECK:      PYBIND11_MODULE(
+// CHECK:      expose_context_Large_part1(context_Large);
+// CHECK-NEXT: expose_context_Large_part2(context_Large);
+// CHECK-NEXT: expose_context_Small(context_Small);
+
+// CHECK-DAG:  void expose_context_Large_part1({{.*}}) {
+// CHECK-DAG:  context.def("first",
+// CHECK-DAG:  context.def("second",
+// CHECK-DAG:  void expose_context_Large_part2({{.*}}) {
+// CHECK-DAG:  context.def("third",
+// CHECK-DAG:  context.def("fourth",
+
+// UNSPLIT-NOT: _part1
@@ -0,0 +1,28 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: rm -rf %t.cache
+// RUN: genpybind-tool --cache-dir=%t.cache -o=%t-1.cpp %s -- %INCLUDES%
+// RUN: genpybind-tool --verbose --cache-dir=%t.cache -o=%t-2.cpp %s \
+// RUN: -- %INCLUDES% 2>&1 | FileCheck %s --check-prefix=HIT
+// RUN: diff %t-1.cpp %t-2.cpp
+// RUN: genpybind-tool --verbose --cache-dir=%t.cache -o=%t-3.cpp %s \
+// RUN: -- %INCLUDES% -DWITH_DOCSTRING 2>&1 | FileCheck %s --check-prefix=MISS
+// RUN: FileCheck %s --check-prefix=DOCSTRING < %t-3.cpp
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+#ifdef WITH_DOCSTRING
+/// Changed docstring.
+#endif
+struct GENPYBIND(visible) Example {};
+
+// HIT:       Using cached bindings for {{.*}}output-cache-skips-parsing-on-hit.h
+
+// MISS:      Adjusting command for file
+// MISS-NOT:  Using cached bindings
+
+// DOCSTRING: Changed docstring.
@@ -0,0 +1,46 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --partition=0/2 -o=%t-0.cpp %s -- %INCLUDES%
+// RUN: genpybind-tool --partition=1/2 -o=%t-1.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s --check-prefix=FIRST < %t-0.cpp
+// RUN: FileCheck %s --check-prefix=SECOND < %t-1.cpp
+// RUN: cat %t-0.cpp %t-1.cpp | FileCheck %s --check-prefix=BOTH
+// RUN: genpybind-tool --shard-assignment=hash --partition=0/2 -o=%t-h0.cpp \
+// RUN: %s -- %INCLUDES%
+// RUN: genpybind-tool --shard-assignment=hash --partition=1/2 -o=%t-h1.cpp \
+// RUN: %s -- %INCLUDES%
+// RUN: cat %t-h0.cpp %t-h1.cpp | FileCheck %s --check-prefix=BOTH
+// RUN: genpybind-tool --xfail --partition=1/2 --max-context-cost=10 \
+// RUN: -o=%t.cpp %s -- %INCLUDES% 2>&1 | FileCheck %s --check-prefix=CONFLICT
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+struct GENPYBIND(visible) Large {
+  void first();
+  void second();
+  void third();
+  void fourth();
+};
+
+struct GENPYBIND(visible) Small {
+  void only();
+};
+
+// FIRST:        void expose_context_Large(
+// FIRST:        void expose_context_Small(
+// FIRST:        PYBIND11_MODULE(
+// FIRST:        expose_context_Large(context_Large);
+// FIRST-NEXT:   expose_context_Small(context_Small);
+
+// SECOND-NOT:   PYBIND11_MODULE(
+// SECOND:       void expose_{{.*}};
+// SECOND-NEXT:  void expose_{{.*}} {
+
+// BOTH-DAG:     void expose_context_Large({{.*}}) {
+// BOTH-DAG:     void expose_context_Small({{.*}}) {
+
+// CONFLICT:     error: --partition cannot be combined with --max-context-cost
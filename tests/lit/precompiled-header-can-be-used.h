@@ -0,0 +1,26 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --generate-pch=%t.pch %S/Inputs/precompiled-prefix.h \
+// RUN: -- %INCLUDES%
+// RUN: genpybind-tool --include-pch=%t.pch -dump-graph=pruned %s \
+// RUN: -- %INCLUDES% 2>&1 \
+// RUN: | FileCheck %s --strict-whitespace
+// RUN: genpybind-tool --verbose --include-pch=%t.pch %s -- %INCLUDES% 2>&1 \
+// RUN: | FileCheck %s --check-prefix=COMMAND
+
+#pragma once
+
+#include "Inputs/precompiled-prefix.h"
+
+#include <genpybind/genpybind.h>
+
+struct GENPYBIND(visible) FromMain {};
+
+// CHECK:     Declaration context graph after pruning:
+// CHECK-DAG: CXXRecord 'prefix::FromPrefix': visible
+// CHECK-DAG: CXXRecord 'FromMain': visible
+
+// COMMAND:      Adjusting command for file {{.*}}precompiled-header-can-be-used.h to
+// COMMAND-NEXT: -include-pch {{.*}}.pch
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --print-stats=%t.json -o=%t-a.cpp -o=%t-b.cpp %s \
+// RUN: -- %INCLUDES%
+// RUN: FileCheck %s < %t.json
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+template <typename T> struct Wrapper {
+  T value;
+};
+
+using WrappedInt GENPYBIND(visible) = Wrapper<int>;
+
+struct GENPYBIND(visible) Example {
+  Example();
+  Example(int);
+
+  void method();
+  void method(int);
+  void other();
+
+  bool operator==(const Example &) const;
+};
+
+// CHECK:      "modules": [
+// CHECK:          "annotated_decls":
+// CHECK:          "cached": false,
+// CHECK:          "contexts": 3,
+// CHECK:          "functions": 4,
+// CHECK:          "graph_nodes":
+// CHECK:          "header": "{{.*}}print-stats-reports-module-statistics.h",
+// CHECK:          "instantiated_specializations": 1,
+// CHECK:          "module": "print_stats_reports_module_statistics",
+// CHECK:          "operator_lambdas": 1,
+// CHECK:          "output_bytes": [
+// CHECK-NEXT:       {{[1-9][0-9]*}},
+// CHECK-NEXT:       {{[1-9][0-9]*}}
+// CHECK-NEXT:     ],
+// CHECK:          "overloads": 6,
+// CHECK:          "phase_seconds": {
+// CHECK-DAG:        "BuildGraph":
+// CHECK-DAG:        "ExposeModule":
+// CHECK-DAG:        "GenerateModule":
+// CHECK-DAG:        "PruneGraph":
+// CHECK:          "pruned_graph_nodes":
+// CHECK:          "visited_decls":
+// CHECK:      "peak_rss_bytes":
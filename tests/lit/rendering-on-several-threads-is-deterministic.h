@@ -0,0 +1,84 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --render-threads=1 -o=%t-1.cpp %s -- %INCLUDES%
+// RUN: genpybind-tool --render-threads=4 -o=%t-4.cpp %s -- %INCLUDES%
+// RUN: diff %t-1.cpp %t-4.cpp
+// RUN: FileCheck %s < %t-4.cpp
+// RUN: genpybind-tool --xfail --render-threads=1 -o=%t-e1.cpp %s \
+// RUN: -- %INCLUDES% -DWITH_ERRORS 2> %t-e1.txt
+// RUN: genpybind-tool --xfail --render-threads=4 -o=%t-e4.cpp %s \
+// RUN: -- %INCLUDES% -DWITH_ERRORS 2> %t-e4.txt
+// RUN: diff %t-e1.txt %t-e4.txt
+// RUN: FileCheck %s --check-prefix=ERRORS < %t-e4.txt
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+namespace pybind11 {
+class args;
+class kwargs;
+} // namespace pybind11
+
+// CHECK-DAG: ::pybind11::enum_<::first::Color>(
+// CHECK-DAG: context.value("red", ::first::Color::red,
+// CHECK-DAG: context.def("__add__", [](const ::first::Point & lhs,
+// CHECK-DAG: "Scale the point.", ::pybind11::arg("factor") = 2
+// CHECK-DAG: context.def_property("x",
+// CHECK-DAG: "Connect two points.", ::pybind11::arg("start"),
+// CHECK-DAG: ::pybind11::arg("color") = ::first::Color::red
+
+namespace first GENPYBIND(visible) {
+
+/// Colors of things.
+enum class Color {
+  red, ///< The red one.
+  green,
+};
+
+struct GENPYBIND(visible) Point {
+  int x_ = 0;
+  int y_ = 0;
+
+  int getX() const GENPYBIND(getter_for("x"));
+  void setX(int value) GENPYBIND(setter_for("x"));
+
+  /// Scale the point.
+  Point scaled(double factor = 2.0, const Point &origin = {}) const;
+
+  Point operator+(const Point &other) const;
+};
+
+} // namespace first
+
+namespace second GENPYBIND(visible) {
+
+struct GENPYBIND(visible) Line {
+  /// Connect two points.
+  Line(first::Point start, first::Point end = {1, 1});
+
+  double length(first::Color color = first::Color::red) const;
+};
+
+} // namespace second
+
+#ifdef WITH_ERRORS
+namespace third GENPYBIND(visible) {
+
+struct GENPYBIND(visible) Broken {
+  // ERRORS-DAG: deterministic.h:[[# @LINE + 1]]:50: error: cannot be followed by other parameters
+  void foo(pybind11::args args, pybind11::kwargs kwargs, bool oops);
+
+  // ERRORS-DAG: deterministic.h:[[# @LINE + 1]]:8: error: No getter for the 'value' property
+  void setValue(int value) GENPYBIND(setter_for("value"));
+};
+
+// ERRORS-DAG: deterministic.h:[[# @LINE + 1]]:48: error: cannot be followed by other parameters
+void bar(pybind11::args args, pybind11::kwargs kwargs, int oops);
+
+} // namespace third
+#endif
+
+// ERRORS: 3 errors generated.
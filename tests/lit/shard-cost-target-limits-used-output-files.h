@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool -o=%t-a.cpp -o=%t-b.cpp -o=%t-c.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s --check-prefix=BALANCED < %t-b.cpp
+// RUN: FileCheck %s --check-prefix=BALANCED < %t-c.cpp
+// RUN: genpybind-tool --shard-cost-target=100000 \
+// RUN:   -o=%t-a.cpp -o=%t-b.cpp -o=%t-c.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s --check-prefix=USED < %t-a.cpp
+// RUN: FileCheck %s --check-prefix=UNUSED < %t-b.cpp
+// RUN: FileCheck %s --check-prefix=UNUSED < %t-c.cpp
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+struct GENPYBIND(visible) Large {
+  void first(int);
+  void first(double);
+  void second(int);
+  void second(double);
+  void third(int);
+  void third(double);
+};
+
+struct GENPYBIND(visible) Medium {
+  void first(int);
+  void second(int);
+};
+
+struct GENPYBIND(visible) Small {};
+
+// BALANCED:      #include <pybind11/pybind11.h>
+// BALANCED:      void expose_{{.*}};
+// BALANCED-NEXT: void expose_{{.*}} {
+
+// USED:          PYBIND11_MODULE(
+// USED-DAG:      void expose_context_Large(
+// USED-DAG:      void expose_context_Medium(
+// USED-DAG:      void expose_context_Small(
+
+// UNUSED:        // No bindings have been assigned to this file.
+// UNUSED-NOT:    #include
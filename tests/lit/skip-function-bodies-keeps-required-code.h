@@ -0,0 +1,29 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --skip-function-bodies -o=%t.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s < %t.cpp
+// RUN: genpybind-tool --xfail %s -- %INCLUDES% 2>&1 \
+// RUN: | FileCheck %s --check-prefix=PARSED
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+struct GENPYBIND(visible) Example {
+  // Only diagnosed if the body is parsed.
+  void broken() { undeclared_function(); }
+  // The body is needed to deduce the return type.
+  auto deduced() { return 42; }
+  void with_default(int value = 123);
+  GENPYBIND_MANUAL({ parent.def("manual", [](int value) { return value; }); })
+};
+
+// CHECK: "broken"
+// CHECK: "deduced"
+// CHECK: "with_default"
+// CHECK-SAME: ::pybind11::arg("value") = 123
+// CHECK: parent.def("manual"
+
+// PARSED: error: use of undeclared identifier 'undeclared_function'
@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool -o=%t.cpp %s -- %INCLUDES% 2>&1 | FileCheck %s
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+template <typename T> struct GENPYBIND(visible) Tag {
+  static constexpr int value = 1;
+};
+
+template <typename T> struct GENPYBIND(hidden) HiddenTag {
+  static constexpr int value = 2;
+};
+
+// The default arguments are only instantiated once the exposed declarations
+// are collected, which is too late for `Tag<int>` to become part of the
+// declaration context graph.
+template <typename T> struct Holder {
+  void method(int value = Tag<T>::value);
+  void hidden(int value = HiddenTag<T>::value);
+};
+
+typedef Holder<int> IntHolder GENPYBIND(expose_here);
+
+// CHECK: warning: 'Tag<int>' is only instantiated by a default argument and thus not exposed
+// CHECK-NOT: HiddenTag
@@ -0,0 +1,25 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool --time-trace=%t.json --time-trace-granularity=0 \
+// RUN: -o=%t.cpp %s -- %INCLUDES%
+// RUN: FileCheck %s < %t.json
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+struct GENPYBIND(visible) Example {
+  void method();
+};
+
+// Clang's own frontend phases are part of the same trace.
+// CHECK-DAG: "name":"Frontend"
+// CHECK-DAG: "name":"GenerateModule"
+// CHECK-DAG: "name":"InstantiateAnnotatedTemplates"
+// CHECK-DAG: "name":"BuildGraph"
+// CHECK-DAG: "name":"DeclContextsWithVisibleNamedDecls"
+// CHECK-DAG: "name":"ExposeModule"
+// CHECK-DAG: "name":"EmitBindings"
+// CHECK-DAG: "name":"ExposeDeclContext"
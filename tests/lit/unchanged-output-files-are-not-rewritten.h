@@ -0,0 +1,27 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+//
+// RUN: genpybind-tool -o=%t.cpp %s -- %INCLUDES%
+// RUN: touch -t 200001010000 %t.cpp
+// RUN: genpybind-tool -o=%t.cpp %s -- %INCLUDES%
+// RUN: find %t.cpp -newermt 2001-01-01 \
+// RUN: | FileCheck %s --allow-empty --check-prefix=UNCHANGED
+// RUN: genpybind-tool -o=%t.cpp %s -- %INCLUDES% -DWITH_DOCSTRING
+// RUN: find %t.cpp -newermt 2001-01-01 | FileCheck %s --check-prefix=CHANGED
+// RUN: FileCheck %s --check-prefix=DOCSTRING < %t.cpp
+
+#pragma once
+
+#include <genpybind/genpybind.h>
+
+#ifdef WITH_DOCSTRING
+/// Changed docstring.
+#endif
+struct GENPYBIND(visible) Example {};
+
+// UNCHANGED-NOT: {{.}}
+
+// CHANGED:       unchanged-output-files-are-not-rewritten.h.tmp.cpp
+
+// DOCSTRING:     Changed docstring.
@@ -0,0 +1,165 @@
+// SPDX-FileCopyrightText: 2024 Johann Klähn <johann@jklaehn.de>
+//
+// SPDX-License-Identifier: MIT
+
+#include "genpybind/shards.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace ::genpybind;
+using ::testing::ElementsAre;
+
+TEST(EstimateCompileCost, GrowsWithDefinitions) {
+  CodeMetrics metrics;
+  const std::uint64_t empty = estimateCompileCost(metrics);
+  ++metrics.defs;
+  const std::uint64_t one = estimateCompileCost(metrics);
+  ++metrics.defs;
+  const std::uint64_t two = estimateCompileCost(metrics);
+  EXPECT_LT(empty, one);
+  EXPECT_LT(one, two);
+}
+
+TEST(EstimateCompileCost, ChargesDistinctSignaturesOnce) {
+  CodeMetrics same;
+  same.addSignature("void (*)(int)");
+  same.addSignature("void (*)(int)");
+  CodeMetrics distinct;
+  distinct.addSignature("void (*)(int)");
+  distinct.addSignature("void (::X::*)(int) const");
+  EXPECT_EQ(same.signatures.size(), 1U);
+  EXPECT_LT(estimateCompileCost(same), estimateCompileCost(distinct));
+}
+
+TEST(CodeMetrics, MergesCountsAndSignatures) {
+  CodeMetrics first;
+  first.defs = 2;
+  first.lambdas = 1;
+  first.bytes = 10;
+  first.addSignature("int (*)()");
+  first.addSignature("void (*)(int)");
+  CodeMetrics second;
+  second.defs = 1;
+  second.wrappers = 1;
+  second.bytes = 5;
+  second.addSignature("double (*)()");
+  second.addSignature("void (*)(int)");
+
+  first += second;
+  EXPECT_EQ(first.defs, 3U);
+  EXPECT_EQ(first.lambdas, 1U);
+  EXPECT_EQ(first.wrappers, 1U);
+  EXPECT_EQ(first.bytes, 15U);
+  EXPECT_THAT(first.signatures,
+              ElementsAre("double (*)()", "int (*)()", "void (*)(int)"));
+}
+
+TEST(ShardCountForCostTarget, IsClampedToAvailableShards) {
+  EXPECT_EQ(shardCountForCostTarget(0, 10, 4), 1U);
+  EXPECT_EQ(shardCountForCostTarget(10, 10, 4), 1U);
+  EXPECT_EQ(shardCountForCostTarget(11, 10, 4), 2U);
+  EXPECT_EQ(shardCountForCostTarget(1000, 10, 4), 4U);
+}
+
+TEST(ParsePartition, AcceptsIndexBelowCount) {
+  unsigned index = 0;
+  unsigned count = 0;
+  EXPECT_TRUE(parsePartition("1/3", index, count));
+  EXPECT_EQ(index, 1U);
+  EXPECT_EQ(count, 3U);
+  EXPECT_FALSE(parsePartition("3/3", index, count));
+  EXPECT_FALSE(parsePartition("1", index, count));
+  EXPECT_FALSE(parsePartition("a/b", index, count));
+  EXPECT_EQ(index, 1U);
+  EXPECT_EQ(count, 3U);
+}
+
+TEST(SplitAtCostLimit, StartsNewPartWhenLimitIsExceeded) {
+  EXPECT_THAT(splitAtCostLimit({}, 10), ElementsAre(0U));
+  EXPECT_THAT(splitAtCostLimit({4, 4, 4, 4}, 10), ElementsAre(0U, 2U));
+  EXPECT_THAT(splitAtCostLimit({5, 5, 5}, 10), ElementsAre(0U, 2U));
+}
+
+TEST(SplitAtCostLimit, KeepsExpensiveItemsInSeparateParts) {
+  EXPECT_THAT(splitAtCostLimit({20, 1, 30}, 10), ElementsAre(0U, 1U, 2U));
+}
+
+TEST(BalanceShards, AssignsExpensiveItemsToSeparateShards) {
+  EXPECT_THAT(balanceShards({1, 100, 1, 100, 1}, 2),
+              ElementsAre(0U, 0U, 1U, 1U, 0U));
+  EXPECT_THAT(balanceShards({5, 5, 5}, 1), ElementsAre(0U, 0U, 0U));
+}
+
+TEST(BalanceShards, AccountsForCostOfFirstShard) {
+  EXPECT_THAT(balanceShards({10, 10}, 2, /*first_shard_cost=*/100),
+              ElementsAre(1U, 1U));
+}
+
+TEST(BalanceShards, IsDeterministic) {
+  const std::vector<std::uint64_t> costs = {3, 7, 7, 2, 9, 4, 4, 1};
+  EXPECT_EQ(balanceShards(costs, 3), balanceShards(costs, 3));
+}
+
+TEST(HashShards, KeepsPlacementOfUnrelatedItems) {
+  std::vector<std::string> names;
+  for (int idx = 0; idx < 64; ++idx)
+    names.push_back("context_" + std::to_string(idx));
+  std::vector<llvm::StringRef> keys(names.begin(), names.end());
+  std::vector<std::uint64_t> costs(keys.size(), 10);
+  const std::vector<unsigned> before = hashShards(keys, costs, 8);
+
+  keys.insert(keys.begin(), "context_new");
+  costs.insert(costs.begin(), 10);
+  const std::vector<unsigned> after = hashShards(keys, costs, 8);
+
+  unsigned moved = 0;
+  for (std::size_t idx = 0; idx < before.size(); ++idx)
+    moved += before[idx] != after[idx + 1] ? 1 : 0;
+  EXPECT_LE(moved, 2U);
+}
+
+TEST(HashShards, ChangingShardCountMovesFewItems) {
+  std::vector<std::string> names;
+  for (int idx = 0; idx < 256; ++idx)
+    names.push_back("context_" + std::to_string(idx));
+  const std::vector<llvm::StringRef> keys(names.begin(), names.end());
+  const std::vector<std::uint64_t> costs(keys.size(), 10);
+  // Disable the load limit, to only observe the effect of the hash function.
+  const std::vector<unsigned> before =
+      hashShards(keys, costs, 8, 0, /*slack=*/100.0);
+  const std::vector<unsigned> after =
+      hashShards(keys, costs, 9, 0, /*slack=*/100.0);
+
+  unsigned moved = 0;
+  for (std::size_t idx = 0; idx < keys.size(); ++idx) {
+    if (before[idx] != after[idx]) {
+      EXPECT_EQ(after[idx], 8U);
+      ++moved;
+    }
+  }
+  EXPECT_LE(moved, 2 * keys.size() / 9);
+}
+
+TEST(HashShards, BoundsLoadOfEachShard) {
+  std::vector<std::string> names;
+  for (int idx = 0; idx < 100; ++idx)
+    names.push_back("context_" + std::to_string(idx));
+  const std::vector<llvm::StringRef> keys(names.begin(), names.end());
+  const std::vector<std::uint64_t> costs(keys.size(), 10);
+  std::vector<std::uint64_t> loads(4, 0);
+  for (unsigned shard : hashShards(keys, costs, 4, 0, /*slack=*/0.1))
+    loads[shard] += 10;
+  for (std::uint64_t load : loads)
+    EXPECT_LE(load, 280U);
+}
+
+} // namespace
@@ -8,25 +8,79 @@ if(NOT CMAKE_EXPORT_COMPILE_COMMANDS)
   set(CMAKE_EXPORT_COMPILE_COMMANDS YES)
 endif()
 
+# Generators other than Ninja and Makefiles only support DEPFILE since 3.21.
+if(CMAKE_GENERATOR MATCHES "Ninja|Makefiles"
+   OR CMAKE_VERSION VERSION_GREATER_EQUAL 3.21)
+  set(_genpybind_use_depfile TRUE)
+else()
+  set(_genpybind_use_depfile FALSE)
+endif()
+
+# Used for `NUM_BINDING_FILES AUTO`: The generated code is spread over at most
+# GENPYBIND_MAX_BINDING_FILES files, each with an estimated compile cost of
+# about GENPYBIND_SHARD_COST_TARGET.  Unneeded files are left empty.
+set(GENPYBIND_MAX_BINDING_FILES 16 CACHE STRING
+  "Maximum number of binding files for NUM_BINDING_FILES AUTO")
+set(GENPYBIND_SHARD_COST_TARGET 3000 CACHE STRING
+  "Estimated compile cost per binding file for NUM_BINDING_FILES AUTO")
+
+# Sets <command-var> to the `add_custom_command` arguments tracking the
+# headers included by <header> and <tool-var> to the corresponding
+# genpybind-tool arguments.  If supported, the tool writes a depfile to
+# <depfile>, which lists exactly the files read during parsing.
+function(_genpybind_dependency_args command_var tool_var header depfile)
+  if(_genpybind_use_depfile)
+    set(${command_var} DEPFILE ${depfile} PARENT_SCOPE)
+    set(${tool_var} "--depfile=${depfile}" PARENT_SCOPE)
+  else()
+    set(${command_var} IMPLICIT_DEPENDS CXX ${header} PARENT_SCOPE)
+    set(${tool_var} "" PARENT_SCOPE)
+  endif()
+endfunction()
+
 # genpybind_add_module(<target-name>
 #                      HEADER <header-file>
 #                      [LINK_LIBRARIES <targets>...]
-#                      [NUM_BINDING_FILES <count>]
+#                      [NUM_BINDING_FILES <count>|AUTO]
+#                      [PARTITIONED]
+#                      [PRECOMPILED_HEADER <pch-target>]
 #                      [EXTRA_ARGS <extra-genpybind-tool-args>...]
 #                      <pybind11_add_module-args>...)
 # Creates a pybind11 module target based on auto-generated bindings for
 # the given header file.  If specified, the generated code is split into
-# several intermediate files to take advantage of parallel builds.
+# several intermediate files to take advantage of parallel builds.  These are
+# balanced by their estimated compile cost.  With AUTO, the number of files
+# actually used is chosen based on GENPYBIND_SHARD_COST_TARGET.  Pass
+# `EXTRA_ARGS --shard-assignment=hash` to keep contexts in the same file when
+# unrelated declarations are added, which reduces incremental rebuilds.  In
+# combination with AUTO, a change of the number of used files only moves the
+# share of contexts that ends up in the added or removed files.
+# With PARTITIONED, each binding file is generated by a separate invocation of
+# genpybind-tool (using `--partition`), s.t. the work after parsing is spread
+# over parallel build jobs.  This works best with a PRECOMPILED_HEADER and
+# requires an explicit number of binding files (i.e., not AUTO).
 # <header-file> is evaluated relative to the source directory.
+# <pch-target> refers to a precompiled header created using
+# `genpybind_add_precompiled_header`.
 function(genpybind_add_module target_name)
-  set(flag_opts "")
-  set(value_opts HEADER)
+  set(flag_opts PARTITIONED)
+  set(value_opts HEADER PRECOMPILED_HEADER)
   set(multi_opts EXTRA_ARGS LINK_LIBRARIES NUM_BINDING_FILES)
   cmake_parse_arguments(
     ARG "${flag_opts}" "${value_opts}" "${multi_opts}" ${ARGN}
   )
 
-  if(NOT DEFINED ARG_NUM_BINDING_FILES OR ARG_NUM_BINDING_FILES LESS 1)
+  set(sharding_args "")
+  if(ARG_NUM_BINDING_FILES STREQUAL "AUTO" AND ARG_PARTITIONED)
+    # Each partition is generated by its own job, which cannot decide to
+    # leave files unused based on the overall cost.
+    message(FATAL_ERROR
+      "genpybind_add_module(${target_name}): NUM_BINDING_FILES AUTO cannot "
+      "be combined with PARTITIONED")
+  elseif(ARG_NUM_BINDING_FILES STREQUAL "AUTO")
+    set(ARG_NUM_BINDING_FILES ${GENPYBIND_MAX_BINDING_FILES})
+    set(sharding_args "--shard-cost-target=${GENPYBIND_SHARD_COST_TARGET}")
+  elseif(NOT DEFINED ARG_NUM_BINDING_FILES OR ARG_NUM_BINDING_FILES LESS 1)
     set(ARG_NUM_BINDING_FILES 1)
   endif()
   math(EXPR index_range "${ARG_NUM_BINDING_FILES} - 1")
@@ -44,21 +98,103 @@ function(genpybind_add_module target_name)
     )
   endforeach()
 
-  list(TRANSFORM bindings PREPEND "-o=" OUTPUT_VARIABLE output_args)
+  set(pch_args "")
+  set(pch_depends "")
+  if(DEFINED ARG_PRECOMPILED_HEADER)
+    get_target_property(pch ${ARG_PRECOMPILED_HEADER} GENPYBIND_PCH_FILE)
+    set(pch_args "--include-pch=${pch}")
+    set(pch_depends ${ARG_PRECOMPILED_HEADER} ${pch})
+  endif()
+
+  if(ARG_PARTITIONED)
+    foreach(idx RANGE ${index_range})
+      list(GET bindings ${idx} binding)
+      set(depfile
+        "${CMAKE_CURRENT_BINARY_DIR}/genpybind-${target_name}-${idx}.d"
+      )
+      _genpybind_dependency_args(
+        dependency_args depfile_args ${ARG_HEADER} ${depfile}
+      )
+      add_custom_command(
+        OUTPUT ${binding}
+        MAIN_DEPENDENCY ${ARG_HEADER}
+        DEPENDS genpybind::genpybind-tool ${pch_depends}
+        ${dependency_args}
+        COMMAND $<TARGET_FILE:genpybind::genpybind-tool>
+        ARGS -p ${CMAKE_BINARY_DIR} --module-name ${target_name} ${ARG_HEADER}
+        -o=${binding} --partition=${idx}/${ARG_NUM_BINDING_FILES}
+        ${depfile_args} ${pch_args} ${ARG_EXTRA_ARGS}
+        COMMENT "Analyzing ${ARG_HEADER} (partition ${idx})"
+        VERBATIM
+      )
+    endforeach()
+  else()
+    set(depfile "${CMAKE_CURRENT_BINARY_DIR}/genpybind-${target_name}.d")
+    _genpybind_dependency_args(
+      dependency_args depfile_args ${ARG_HEADER} ${depfile}
+    )
+
+    list(TRANSFORM bindings PREPEND "-o=" OUTPUT_VARIABLE output_args)
+    add_custom_command(
+      OUTPUT ${bindings}
+      MAIN_DEPENDENCY ${ARG_HEADER}
+      DEPENDS genpybind::genpybind-tool ${pch_depends}
+      ${dependency_args}
+      COMMAND $<TARGET_FILE:genpybind::genpybind-tool>
+      ARGS -p ${CMAKE_BINARY_DIR} --module-name ${target_name} ${ARG_HEADER}
+      ${output_args} ${depfile_args} ${pch_args} ${sharding_args}
+      ${ARG_EXTRA_ARGS}
+      COMMENT "Analyzing ${ARG_HEADER}"
+      VERBATIM
+    )
+  endif()
+
+  pybind11_add_module(${target_name} ${bindings} ${ARG_UNPARSED_ARGUMENTS})
+  target_link_libraries(
+    ${target_name} PRIVATE ${ARG_LINK_LIBRARIES} genpybind::genpybind
+  )
+endfunction()
+
+# genpybind_add_precompiled_header(<target-name>
+#                                  HEADER <header-file>
+#                                  [EXTRA_ARGS <extra-genpybind-tool-args>...])
+# Creates a target that precompiles the given header file, which should
+# include the common dependencies of several binding modules (e.g., pybind11,
+# the standard library or other large libraries).  Pass <target-name> as
+# PRECOMPILED_HEADER to `genpybind_add_module` to parse these only once per
+# build.  All modules using the precompiled header need to be analyzed with
+# compatible compiler flags.
+# <header-file> is evaluated relative to the source directory.
+function(genpybind_add_precompiled_header target_name)
+  set(flag_opts "")
+  set(value_opts HEADER)
+  set(multi_opts EXTRA_ARGS)
+  cmake_parse_arguments(
+    ARG "${flag_opts}" "${value_opts}" "${multi_opts}" ${ARGN}
+  )
+
+  get_filename_component(
+    ARG_HEADER ${ARG_HEADER} ABSOLUTE
+    BASE_DIR ${CMAKE_CURRENT_SOURCE_DIR}
+  )
+
+  set(pch "${CMAKE_CURRENT_BINARY_DIR}/genpybind-${target_name}.pch")
+  _genpybind_dependency_args(
+    dependency_args depfile_args ${ARG_HEADER} ${pch}.d
+  )
+
   add_custom_command(
-    OUTPUT ${bindings}
+    OUTPUT ${pch}
     MAIN_DEPENDENCY ${ARG_HEADER}
     DEPENDS genpybind::genpybind-tool
-    IMPLICIT_DEPENDS CXX ${ARG_HEADER}
+    ${dependency_args}
     COMMAND $<TARGET_FILE:genpybind::genpybind-tool>
-    ARGS -p ${CMAKE_BINARY_DIR} --module-name ${target_name} ${ARG_HEADER}
-    ${output_args} ${ARG_EXTRA_ARGS}
-    COMMENT "Analyzing ${ARG_HEADER}"
+    ARGS -p ${CMAKE_BINARY_DIR} --generate-pch=${pch} ${ARG_HEADER}
+    ${depfile_args} ${ARG_EXTRA_ARGS}
+    COMMENT "Precompiling ${ARG_HEADER}"
     VERBATIM
   )
 
-  pybind11_add_module(${target_name} ${bindings} ${ARG_UNPARSED_ARGUMENTS})
-  target_link_libraries(
-    ${target_name} PRIVATE ${ARG_LINK_LIBRARIES} genpybind::genpybind
-  )
+  add_custom_target(${target_name} DEPENDS ${pch})
+  set_target_properties(${target_name} PROPERTIES GENPYBIND_PCH_FILE ${pch})
 endfunction()